@@ -0,0 +1,2389 @@
+// See LICENSE for license details.
+
+#include "cachesim.h"
+#include "common.h"
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CACHESIM_X86_SIMD   // 可以用 SSE4.2 / AVX2 一次比對多個 tag
+#endif
+
+// 定義 cache_sim_t 的 construst，不需要回傳型態
+cache_sim_t::cache_sim_t(size_t _sets, size_t _ways, size_t _linesz, const char* _name, size_t _meta_bytes) 
+: sets(_sets), ways(_ways), linesz(_linesz), meta_bytes(_meta_bytes), name(_name), log(false), printed(false), stats_sink(NULL), series(NULL), series_left(0), sample_period(0), prefetcher(NULL),
+  inclusion(NINE), owned_lower(NULL), side_kind(NO_SIDE), side(NULL), shadow(NULL)
+{
+  init();
+}
+
+static void help()  // 印出錯誤提示
+{
+  std::cerr << "Cache configurations must be of the form" << std::endl;
+  std::cerr << "  sets:ways:blocksize[:policy][:option=value...]" << std::endl;
+  std::cerr << "where sets, ways, and blocksize are positive integers, with" << std::endl;
+  std::cerr << "sets and blocksize both powers of two and blocksize at least 8." << std::endl;
+  std::cerr << "policy is one of random (default), fifo, lru, lfu, lfru, plru (tree-PLRU)," << std::endl;
+  std::cerr << "bitplru (bit-PLRU), srrip, brrip or drrip (drrip needs at least 4 sets)." << std::endl;
+  std::cerr << "A set-associative cache has at most 64 ways, a single set (fully associative) may have more." << std::endl;
+  std::cerr << "More levels below --l2 follow after commas, e.g. --l2=512:8:64:lru,4096:16:64:srrip:inclusion=exclusive" << std::endl;
+  std::cerr << "gives an L3$ below the L2$." << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  sat=N    lfu/lfru: use counts saturate at N" << std::endl;
+  std::cerr << "  age=N    lfu/lfru: halve all use counts every N accesses" << std::endl;
+  std::cerr << "  rrpv=N   srrip/brrip/drrip: bits per RRPV, 1 to 3 (default 2)" << std::endl;
+  std::cerr << "  bip=N    brrip/drrip: one in N insertions is not distant (default 32)" << std::endl;
+  std::cerr << "  trace=F  --ic/--dc only: also record every reference to the binary trace file F," << std::endl;
+  std::cerr << "           I$ and D$ given the same F write one interleaved trace" << std::endl;
+  std::cerr << "  async    --ic/--dc only: simulate on a separate thread, give it to both I$ and D$" << std::endl;
+  std::cerr << "           when they share an L2" << std::endl;
+  std::cerr << "  stats=F  write all counters of this cache to F at exit, JSON or CSV if F ends in .csv," << std::endl;
+  std::cerr << "           caches given the same F write one file" << std::endl;
+  std::cerr << "  bench=B  stats=: benchmark name recorded with the counters" << std::endl;
+  std::cerr << "  sample=N simulate only about one in N sets, chosen by a hash of the set index, and estimate" << std::endl;
+  std::cerr << "           the misses of the others, the miss rate is printed with a 95% confidence interval" << std::endl;
+  std::cerr << "           (needs at least 2 sets, the next level only sees the misses of the sampled sets)" << std::endl;
+  std::cerr << "  prefetch=next|stride|stream" << std::endl;
+  std::cerr << "           hardware prefetcher: next-line, constant strides per 4 KiB region or stream buffers," << std::endl;
+  std::cerr << "           not together with sample=" << std::endl;
+  std::cerr << "  degree=N prefetch: lines prefetched each time (default 1)" << std::endl;
+  std::cerr << "  distance=N" << std::endl;
+  std::cerr << "           prefetch: how many lines (strides) ahead the first prefetch is (default 1)" << std::endl;
+  std::cerr << "  entries=N" << std::endl;
+  std::cerr << "           prefetch: stride table entries (default 64) or streams (default 8)" << std::endl;
+  std::cerr << "  latency=N" << std::endl;
+  std::cerr << "           prefetch: a prefetch used less than N accesses after it was issued is late (default 16)" << std::endl;
+  std::cerr << "  inclusion=nine|inclusive|exclusive" << std::endl;
+  std::cerr << "           --l2 levels: relation to the caches above, inclusive evicts its blocks from them too," << std::endl;
+  std::cerr << "           exclusive only holds their victims (default nine: neither), not together with sample=" << std::endl;
+  std::cerr << "  victim=N misscache=N" << std::endl;
+  std::cerr << "           N-entry fully associative LRU victim cache (evicted blocks, swapped back on a hit) or" << std::endl;
+  std::cerr << "           miss cache (copies of fetched blocks) in front of the next level, not together with" << std::endl;
+  std::cerr << "           sample= or inclusion=exclusive" << std::endl;
+  std::cerr << "  classify split the misses into compulsory, capacity and conflict misses, by a fully associative" << std::endl;
+  std::cerr << "           LRU shadow cache of the same size, not together with sample= or inclusion=exclusive" << std::endl;
+  std::cerr << "  series=F interval=N[inst]" << std::endl;
+  std::cerr << "           write the change of every counter in each interval of N accesses to this cache," << std::endl;
+  std::cerr << "           or of N instructions (inst, --ic/--dc only), to F, CSV if F ends in .csv, binary otherwise," << std::endl;
+  std::cerr << "           with sample=N the rows count the references to the sampled sets" << std::endl;
+  exit(1);
+}
+
+// construct() 建立的 cache 都包在這一層：spike 會先刪除 L2，而 async 佇列中的 references 可能還要用到它，
+// 所以最外層的 destructor 要在 policy 的部分被解構之前先等佇列清空
+template <class cache_t>
+class synced_cache_t : public cache_t
+{
+ public:
+  template <typename... args_t>
+  synced_cache_t(args_t... args) : cache_t(args...) {}
+  ~synced_cache_t()
+  {
+    async_sim_t::sync();
+    this->emit_stats();
+    this->print_stats();
+  }
+};
+
+// 取出 option 'key' 的值並從 options 中移除，沒有設定時回傳 'dflt'
+static uint64_t take_option(std::map<std::string, std::string>& options, const char* key, uint64_t dflt)
+{
+  auto it = options.find(key);
+  if (it == options.end())
+    return dflt;
+  char* end;
+  uint64_t value = strtoull(it->second.c_str(), &end, 0);
+  if (it->second.empty() || *end)
+    help();
+  options.erase(it);
+  return value;
+}
+
+// cache_sim_t 的 construct 為根據 config 和 cache policy name 配置 cache
+// "L2$" -> "L3$"
+static std::string next_level_name(const std::string& name)
+{
+  size_t d = name.find_first_of("0123456789");
+  if (d == std::string::npos)
+    return name + "+";
+  size_t e = name.find_first_not_of("0123456789", d);
+  size_t len = e == std::string::npos ? std::string::npos : e - d;
+  return name.substr(0, d) + std::to_string(atoi(name.substr(d, len).c_str()) + 1) + (len == std::string::npos ? "" : name.substr(e));
+}
+
+cache_sim_t* cache_sim_t::construct(const char* config, const char* name) 
+{
+  // 以 ',' 分隔的多層 config：第一層是回傳的 cache，其餘各層依序接在下面並由上一層擁有
+  if (const char* comma = strchr(config, ',')) {
+    cache_sim_t* upper = construct(std::string(config, comma).c_str(), name);
+    cache_sim_t* lower = construct(comma + 1, next_level_name(name).c_str());
+    upper->set_miss_handler(lower);
+    upper->owned_lower = lower;
+    return upper;
+  }
+
+  // stats=path 與 bench=name 只決定統計寫到哪裡，不屬於 cache 本身的設定
+  std::string cache_config = config, stats_path, bench;
+  if (cache_memtracer_t::take_config_field(cache_config, "stats", stats_path) && stats_path.empty())
+    help();
+  cache_memtracer_t::take_config_field(cache_config, "bench", bench);
+  std::string series_path, interval, classify_value;
+  bool classify = cache_memtracer_t::take_config_field(cache_config, "classify", classify_value);
+  if (!classify_value.empty())
+    help();
+  bool has_series = cache_memtracer_t::take_config_field(cache_config, "series", series_path);
+  bool has_interval = cache_memtracer_t::take_config_field(cache_config, "interval", interval);
+  char* interval_unit;
+  uint64_t period = strtoull(interval.c_str(), &interval_unit, 0);
+  bool instructions = strcmp(interval_unit, "inst") == 0;
+  if (has_series != has_interval || (has_series && (series_path.empty() || period == 0 || (*interval_unit && !instructions))))
+    help();
+  config = cache_config.c_str();
+
+  const char* wp = strchr(config, ':');
+  if (!wp++) help();
+  const char* bp = strchr(wp, ':');
+  if (!bp++) help();
+
+  size_t sets = atoi(std::string(config, wp).c_str());
+  size_t ways = atoi(std::string(wp, bp).c_str());
+  size_t linesz = atoi(bp);
+
+  // blocksize 之後的欄位為 replacement policy 或 option=value，e.g. 64:4:32:lfu:sat=15
+  std::string policy;
+  std::map<std::string, std::string> options;
+  for (const char* fp = strchr(bp, ':'); fp; fp = strchr(fp, ':')) {
+    const char* ep = strchr(++fp, ':');
+    std::string field = ep ? std::string(fp, ep) : std::string(fp);
+    if (field.empty())    // e.g. 64:4:32:lru: from an empty make variable
+      continue;
+    size_t eq = field.find('=');
+    if (eq == std::string::npos)
+      policy = field;
+    else
+      options[field.substr(0, eq)] = field.substr(eq + 1);
+  }
+
+  bool random = policy == "" || policy == "random" || policy == "origin";
+  uint64_t sample = take_option(options, "sample", 0);   // 所有 policy 都可以使用
+  if (sample && sets < 2)
+    help();
+  inclusion_t inclusion = NINE;
+  if (options.count("inclusion")) {
+    std::string mode = options["inclusion"];
+    options.erase("inclusion");
+    if (mode == "inclusive")
+      inclusion = INCLUSIVE;
+    else if (mode == "exclusive")
+      inclusion = EXCLUSIVE;
+    else if (mode != "nine")
+      help();
+    if (sample)
+      help();
+  }
+  prefetcher_t* prefetcher = NULL;
+  uint64_t prefetch_latency = 0;
+  if (options.count("prefetch")) {
+    std::string kind = options["prefetch"];
+    options.erase("prefetch");
+    uint64_t degree = take_option(options, "degree", 1);
+    uint64_t distance = take_option(options, "distance", 1);
+    uint64_t entries = take_option(options, "entries", kind == "stream" ? 8 : 64);
+    prefetch_latency = take_option(options, "latency", 16);
+    size_t line_shift = linesz ? __builtin_ctzll(linesz) : 0;
+    if (degree == 0 || distance == 0 || entries == 0 || sample   // prefetchers learn from the neighboring sets
+        || !(prefetcher = prefetcher_t::construct(kind, line_shift, degree, distance, entries)))
+      help();
+  }
+  uint64_t victim_entries = take_option(options, "victim", 0);
+  uint64_t miss_entries = take_option(options, "misscache", 0);
+  if ((victim_entries || miss_entries) && (sample || inclusion == EXCLUSIVE || (victim_entries && miss_entries)))
+    help();
+  if (victim_entries > 64 || miss_entries > 64)    // 逐一比對，只適合少數幾個 entries
+    help();
+  if (classify && (sample || inclusion == EXCLUSIVE))
+    help();
+  if (ways == 0 || (ways > 64 && sets != 1))   // 只有 fully associative cache 可以超過 64 ways
+    help();
+
+  cache_sim_t* cache;
+  if (sets == 1 && ways > 64)           // large fully associative cache
+  {
+    fa_cache_sim_t::policy_t fa_policy = fa_cache_sim_t::RANDOM;
+    if (policy == "fifo")
+      fa_policy = fa_cache_sim_t::FIFO;
+    else if (policy == "lru")
+      fa_policy = fa_cache_sim_t::LRU;
+    else if (policy == "lfu")
+      fa_policy = fa_cache_sim_t::LFU;
+    else if (policy == "lfru" || policy == "self")
+      fa_policy = fa_cache_sim_t::LFRU;
+    else if (policy == "plru")
+      fa_policy = fa_cache_sim_t::PLRU;
+    else if (policy == "bitplru")
+      fa_policy = fa_cache_sim_t::BIT_PLRU;
+    else if (policy == "srrip")
+      fa_policy = fa_cache_sim_t::SRRIP;
+    else if (policy == "brrip")
+      fa_policy = fa_cache_sim_t::BRRIP;
+    else if (!random)                   // DRRIP needs more than one set to duel
+      help();
+    bool lfu = fa_policy == fa_cache_sim_t::LFU || fa_policy == fa_cache_sim_t::LFRU;
+    bool rrip = fa_policy == fa_cache_sim_t::SRRIP || fa_policy == fa_cache_sim_t::BRRIP;
+    uint64_t sat = lfu ? take_option(options, "sat", UINT32_MAX) : UINT32_MAX;
+    uint64_t age = lfu ? take_option(options, "age", 0) : 0;
+    uint64_t rrpv = rrip ? take_option(options, "rrpv", 2) : 2;
+    uint64_t bip = rrip ? take_option(options, "bip", 32) : 32;
+    if (sat == 0 || sat > UINT32_MAX || rrpv < 1 || rrpv > 3 || bip == 0)
+      help();
+    cache = new synced_cache_t<fa_cache_sim_t>(ways, linesz, name, fa_policy, sat, age, rrpv, bip);
+  }
+  else if (policy == "fifo")
+    cache = new synced_cache_t<fifo_cache_sim_t>(sets, ways, linesz, name);
+  else if (policy == "lru")
+    cache = new synced_cache_t<lru_cache_sim_t>(sets, ways, linesz, name);
+  else if (policy == "plru")
+    cache = new synced_cache_t<plru_cache_sim_t>(sets, ways, linesz, name);
+  else if (policy == "bitplru")
+    cache = new synced_cache_t<bit_plru_cache_sim_t>(sets, ways, linesz, name);
+  else if (policy == "srrip" || policy == "brrip" || policy == "drrip")
+  {
+    uint64_t rrpv = take_option(options, "rrpv", 2);
+    uint64_t bip = take_option(options, "bip", 32);
+    if (rrpv < 1 || rrpv > 3 || bip == 0 || (policy == "drrip" && sets < 4))
+      help();
+    rrip_cache_sim_t::mode_t mode = policy == "srrip" ? rrip_cache_sim_t::SRRIP
+                                  : policy == "brrip" ? rrip_cache_sim_t::BRRIP : rrip_cache_sim_t::DRRIP;
+    cache = new synced_cache_t<rrip_cache_sim_t>(sets, ways, linesz, name, mode, rrpv, bip);
+  }
+  else if (policy == "lfu" || policy == "lfru" || policy == "self")
+  {
+    uint64_t sat = take_option(options, "sat", UINT32_MAX);
+    uint64_t age = take_option(options, "age", 0);
+    if (sat == 0 || sat > UINT32_MAX)
+      help();
+    if (policy == "lfu")
+      cache = new synced_cache_t<lfu_cache_sim_t>(sets, ways, linesz, name, sat, age);
+    else
+      cache = new synced_cache_t<lfru_cache_sim_t>(sets, ways, linesz, name, sat, age);
+  }
+  else if (!random)
+    help();
+  else if (ways > 4 /* empirical */ && sets == 1)
+    cache = new synced_cache_t<fa_cache_sim_t>(ways, linesz, name);    // fully associative cache
+  else
+    cache = new synced_cache_t<cache_sim_t>(sets, ways, linesz, name);
+
+  if (!options.empty())   // 有不認得或不適用於此 policy 的 option
+    help();
+
+  if (!stats_path.empty()) {
+    stats_record_t meta;
+    meta.add("cache", std::string(name));
+    meta.add("config", cache_config);
+    meta.add("policy", policy.empty() ? std::string("random") : policy);
+    meta.add("bench", bench);
+    cache->set_stats_sink(stats_sink_t::open(stats_path), meta);
+  }
+  if (sample)
+    cache->set_sampling(sample);
+  if (prefetcher)
+    cache->set_prefetcher(prefetcher, prefetch_latency);
+  cache->set_inclusion(inclusion);
+  if (victim_entries)
+    cache->set_side_buffer(VICTIM_CACHE, victim_entries);
+  if (miss_entries)
+    cache->set_side_buffer(MISS_CACHE, miss_entries);
+  if (classify)
+    cache->set_classify();
+  if (has_series)
+    cache->set_series(new series_writer_t(series_path, instructions), period, instructions);
+  return cache;
+}
+
+// 比對 set 中前 n 個 tag，回傳相符的 way bitmask (bit i 代表 way i)，n 為 8 的倍數且不超過 64
+static uint64_t match_tags_scalar(const uint64_t* tags, size_t n, uint64_t tag)
+{
+  uint64_t match = 0;
+  for (size_t i = 0; i < n; i++)
+    match |= (uint64_t)(tags[i] == tag) << i;
+  return match;
+}
+
+#ifdef CACHESIM_X86_SIMD
+__attribute__((target("sse4.2")))
+static uint64_t match_tags_sse42(const uint64_t* tags, size_t n, uint64_t tag)
+{
+  __m128i key = _mm_set1_epi64x(tag);
+  uint64_t match = 0;
+  for (size_t i = 0; i < n; i += 2) {   // 每個指令比對 2 個 tag
+    __m128i eq = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i*)(tags + i)), key);
+    match |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+  }
+  return match;
+}
+
+__attribute__((target("avx2")))
+static uint64_t match_tags_avx2(const uint64_t* tags, size_t n, uint64_t tag)
+{
+  __m256i key = _mm256_set1_epi64x(tag);
+  uint64_t match = 0;
+  for (size_t i = 0; i < n; i += 4) {   // 每個指令比對 4 個 tag
+    __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(tags + i)), key);
+    match |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+  }
+  return match;
+}
+#endif
+
+void cache_sim_t::init()  // 初始化
+{
+  if (sets == 0 || (sets & (sets-1)))       // 若 sets==0 或是 sets 不是 2 的冪次方，則印出錯誤提示   
+    help();
+  if (linesz < 8 || (linesz & (linesz-1)))  // 若 block size < 8 或是 block size 不是 2 的冪次方，則印出錯誤提示
+    help();
+
+  idx_shift = 0;                            // idx_shift 為根據 linesz(block size)大小，計算 offset 所對應的 bits 數
+  for (size_t x = linesz; x>1; x >>= 1)
+    idx_shift++;
+
+  // 每個 set 是一筆連續的 record：valid bitmask、dirty bitmask、ways 個 tag，之後接著 replacement policy 的 metadata，
+  // 並補齊到 host cache line (64 bytes) 的倍數，lookup 與選 victim 只會碰到同一筆 record。
+  // tag 的個數補齊到 8 的倍數，SIMD 比對時可以整組讀取，多出來的 way 不會是 valid
+  mask_words = (ways + 63) / 64;
+  tag_slots = (ways + 7) & ~(size_t)7;
+  set_bytes = (2*mask_words*sizeof(uint64_t) + tag_slots*sizeof(uint64_t) + meta_bytes + 63) & ~(size_t)63;
+  set_records = sets;
+  set_mem = new uint8_t[sets*set_bytes + 63]();   // ()為初始化為0，多配置 63 bytes 以對齊 64 bytes
+  set_base = (uint8_t*)(((uintptr_t)set_mem + 63) & ~(uintptr_t)63);
+
+  match_tags = NULL;                        // 依 ways 自動選擇 tag 比對方式，NULL 為逐一比對
+  if (ways >= 4 && ways <= 64) {
+    match_tags = match_tags_scalar;
+#ifdef CACHESIM_X86_SIMD
+    if (ways >= 8 && __builtin_cpu_supports("avx2"))
+      match_tags = match_tags_avx2;
+    else if (__builtin_cpu_supports("sse4.2"))
+      match_tags = match_tags_sse42;
+#endif
+  }
+
+  read_accesses = 0;
+  read_misses = 0;
+  bytes_read = 0;
+  write_accesses = 0;
+  write_misses = 0;
+  bytes_written = 0;
+  writebacks = 0;
+  skipped_reads = skipped_writes = 0;
+  skipped_bytes_read = skipped_bytes_written = 0;
+  prefetches_issued = prefetches_useful = prefetches_late = prefetches_polluting = 0;
+  back_invalidations = victims_inserted = 0;
+  side_hits = writebacks_saved = 0;
+  compulsory_misses = capacity_misses = conflict_misses = 0;
+
+  miss_handler = NULL;
+}
+
+cache_sim_t::cache_sim_t(const cache_sim_t& rhs)     
+ : sets(rhs.sets), ways(rhs.ways), linesz(rhs.linesz), meta_bytes(rhs.meta_bytes),
+   idx_shift(rhs.idx_shift), mask_words(rhs.mask_words), tag_slots(rhs.tag_slots), set_bytes(rhs.set_bytes),
+   match_tags(rhs.match_tags), name(rhs.name), log(false), printed(false), stats_sink(NULL), series(NULL), series_left(0),
+   sample_period(rhs.sample_period), sample_slot(rhs.sample_slot),
+   sample_accesses(rhs.sample_accesses.size(), 0), sample_misses(rhs.sample_misses.size(), 0),
+   prefetcher(NULL), inclusion(rhs.inclusion), owned_lower(NULL), side_kind(NO_SIDE), side(NULL), shadow(NULL)
+{
+  set_records = rhs.set_records;
+  set_mem = new uint8_t[set_records*set_bytes + 63];          // 為 set records 配置新記憶體空間
+  set_base = (uint8_t*)(((uintptr_t)set_mem + 63) & ~(uintptr_t)63);
+  memcpy(set_base, rhs.set_base, set_records*set_bytes);      // 把 'rhs' object 的 set records (tags 與 metadata) 複製過來
+}
+
+cache_sim_t::~cache_sim_t()  // 'cache_sim_t' class 的 destructor, when an object of the 'cache_sim_t' class is destroyed, the destructor will be called
+{
+  emit_stats();     // construct() 建立的 cache 已經在最外層送出過了
+  if (series)
+    close_series(series_insts ? 0 : read_accesses + write_accesses);
+  print_stats();    // construct() 建立的 cache 已經在最外層印過了
+  delete prefetcher;
+  delete side;
+  delete shadow;
+  delete [] set_mem;   // 釋放 set records 的記憶體空間 
+  delete owned_lower;  // spike 只刪除 L2，更下層的在 L2 之後印出統計
+}
+
+void cache_sim_t::take_stats(cache_sim_t& rhs)
+{
+  read_accesses += rhs.read_accesses;
+  read_misses += rhs.read_misses;
+  bytes_read += rhs.bytes_read;
+  write_accesses += rhs.write_accesses;
+  write_misses += rhs.write_misses;
+  bytes_written += rhs.bytes_written;
+  writebacks += rhs.writebacks;
+  rhs.read_accesses = rhs.read_misses = rhs.bytes_read = 0;
+  rhs.write_accesses = rhs.write_misses = rhs.bytes_written = 0;
+  rhs.writebacks = 0;
+
+  skipped_reads += rhs.skipped_reads;
+  skipped_writes += rhs.skipped_writes;
+  skipped_bytes_read += rhs.skipped_bytes_read;
+  skipped_bytes_written += rhs.skipped_bytes_written;
+  rhs.skipped_reads = rhs.skipped_writes = rhs.skipped_bytes_read = rhs.skipped_bytes_written = 0;
+  prefetches_issued += rhs.prefetches_issued;
+  prefetches_useful += rhs.prefetches_useful;
+  prefetches_late += rhs.prefetches_late;
+  prefetches_polluting += rhs.prefetches_polluting;
+  rhs.prefetches_issued = rhs.prefetches_useful = rhs.prefetches_late = rhs.prefetches_polluting = 0;
+  back_invalidations += rhs.back_invalidations;
+  victims_inserted += rhs.victims_inserted;
+  rhs.back_invalidations = rhs.victims_inserted = 0;
+  side_hits += rhs.side_hits;
+  writebacks_saved += rhs.writebacks_saved;
+  rhs.side_hits = rhs.writebacks_saved = 0;
+  compulsory_misses += rhs.compulsory_misses;
+  capacity_misses += rhs.capacity_misses;
+  conflict_misses += rhs.conflict_misses;
+  rhs.compulsory_misses = rhs.capacity_misses = rhs.conflict_misses = 0;
+  for (size_t i = 0; i < sample_accesses.size() && i < rhs.sample_accesses.size(); i++) {
+    sample_accesses[i] += rhs.sample_accesses[i];
+    sample_misses[i] += rhs.sample_misses[i];
+    rhs.sample_accesses[i] = rhs.sample_misses[i] = 0;
+  }
+}
+
+void cache_sim_t::emit_stats()
+{
+  if (!stats_sink)
+    return;
+  uint64_t total[series_writer_t::FIELDS - 1];
+  totals(total);
+  if (total[2] + total[3] != 0) {   // 與 print_stats 相同，沒有被使用的 cache 不輸出
+    stats_record_t record = stats_meta;
+    record.add("bytes_read", total[0]);
+    record.add("bytes_written", total[1]);
+    record.add("read_accesses", total[2]);
+    record.add("write_accesses", total[3]);
+    record.add("read_misses", total[4]);
+    record.add("write_misses", total[5]);
+    record.add("writebacks", total[6]);
+    record.add("miss_rate", read_accesses + write_accesses ? 100.0*(read_misses+write_misses)/(read_accesses+write_accesses) : 0.0);
+    if (sample_period) {
+      record.add("sampled_sets", uint64_t(sample_accesses.size()));
+      record.add("miss_rate_ci95", miss_rate_ci95());
+    }
+    if (prefetcher) {
+      record.add("prefetches_issued", scaled(prefetches_issued));
+      record.add("prefetches_useful", scaled(prefetches_useful));
+      record.add("prefetches_late", scaled(prefetches_late));
+      record.add("prefetches_polluting", scaled(prefetches_polluting));
+    }
+    if (inclusion == INCLUSIVE)
+      record.add("back_invalidations", back_invalidations);
+    if (inclusion == EXCLUSIVE)
+      record.add("victims_inserted", victims_inserted);
+    if (side) {
+      uint64_t fetches = read_misses + write_misses;
+      record.add(side_kind == VICTIM_CACHE ? "victim_cache_hits" : "miss_cache_hits", side_hits);
+      record.add("next_level_bytes", (fetches - side_hits + writebacks) * linesz);
+      record.add("next_level_bytes_saved", (side_hits + writebacks_saved) * linesz);
+    }
+    if (shadow) {
+      record.add("compulsory_misses", compulsory_misses);
+      record.add("capacity_misses", capacity_misses);
+      record.add("conflict_misses", conflict_misses);
+    }
+    policy_stats(record);
+    stats_sink->add(record);
+  }
+  stats_sink_t::close(stats_sink);
+  stats_sink = NULL;
+}
+
+void cache_sim_t::set_series(series_writer_t* writer, uint64_t period, bool instructions)
+{
+  series = writer;
+  series_period = period;
+  series_insts = instructions;
+  series_left = instructions ? 0 : period + 1;   // access() 在第 period+1 個 access 開始前 snapshot
+  memset(series_last, 0, sizeof(series_last));
+}
+
+void cache_sim_t::snapshot(uint64_t position)
+{
+  uint64_t now[] = { bytes_read, bytes_written, read_accesses, write_accesses, read_misses, write_misses, writebacks };
+  uint64_t row[series_writer_t::FIELDS];
+  row[0] = position;
+  for (size_t i = 0; i < series_writer_t::FIELDS - 1; i++) {
+    row[i + 1] = now[i] - series_last[i];
+    series_last[i] = now[i];
+  }
+  series->put(row);
+}
+
+void cache_sim_t::close_series(uint64_t position)
+{
+  if (read_accesses + write_accesses != series_last[2] + series_last[3])   // 最後一段不滿一個 interval
+    snapshot(position);
+  delete series;
+  series = NULL;
+  series_left = 0;
+}
+
+void cache_sim_t::set_sampling(uint64_t period)
+{
+  sample_period = period;
+  sample_slot.assign(sets, -1);
+  int32_t n = 0;
+  for (size_t idx = 0; idx < sets; idx++) {
+    uint64_t h = idx * 0x9e3779b97f4a7c15ULL;     // splitmix64 finalizer，相鄰的 sets 也分散
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    if (h % period == 0)
+      sample_slot[idx] = n++;
+  }
+  if (n < 2)    // 至少要兩個 sets 才能估計變異
+    for (size_t idx = 0; idx < sets && n < 2; idx++)
+      if (sample_slot[idx] < 0)
+        sample_slot[idx] = n++;
+  sample_accesses.assign(n, 0);
+  sample_misses.assign(n, 0);
+
+  // 只留下 sampled sets 的 set records (policy 的 constructor 已經初始化過)，依 sample_slot 排列
+  uint8_t* mem = new uint8_t[n*set_bytes + 63];
+  uint8_t* base = (uint8_t*)(((uintptr_t)mem + 63) & ~(uintptr_t)63);
+  for (size_t idx = 0; idx < sets; idx++)
+    if (sample_slot[idx] >= 0)
+      memcpy(base + sample_slot[idx]*set_bytes, set_base + idx*set_bytes, set_bytes);
+  delete [] set_mem;
+  set_mem = mem;
+  set_base = base;
+  set_records = n;
+}
+
+void cache_sim_t::totals(uint64_t* out) const
+{
+  out[0] = bytes_read + skipped_bytes_read;
+  out[1] = bytes_written + skipped_bytes_written;
+  out[2] = read_accesses + skipped_reads;
+  out[3] = write_accesses + skipped_writes;
+  out[4] = scaled(read_misses);
+  out[5] = scaled(write_misses);
+  out[6] = scaled(writebacks);
+}
+
+uint64_t cache_sim_t::scaled(uint64_t count) const
+{
+  if (!sample_period)
+    return count;
+  uint64_t sampled = read_accesses + write_accesses;
+  uint64_t total = sampled + skipped_reads + skipped_writes;
+  return sampled ? uint64_t(double(count) * total / sampled + 0.5) : 0;
+}
+
+double cache_sim_t::miss_rate_ci95() const
+{
+  // ratio estimator r = sum(misses) / sum(accesses) over the n sampled sets of N (cluster sampling):
+  // var(r) = (1 - n/N) * sum((m_i - r a_i)^2) / (n - 1) / (n * mean(a)^2)
+  size_t n = sample_accesses.size();
+  uint64_t accesses = read_accesses + write_accesses;
+  if (n < 2 || accesses == 0)
+    return -1;
+  double r = double(read_misses + write_misses) / accesses;
+  double mean = double(accesses) / n;
+  double ss = 0;
+  for (size_t i = 0; i < n; i++) {
+    double d = sample_misses[i] - r * sample_accesses[i];
+    ss += d * d;
+  }
+  double var = (1.0 - double(n) / sets) * ss / (n - 1) / (n * mean * mean);
+  return 100.0 * 1.96 * sqrt(var);
+}
+
+void cache_sim_t::set_prefetcher(prefetcher_t* p, uint64_t latency)
+{
+  delete prefetcher;
+  prefetcher = p;
+  prefetch_latency = latency;
+  prefetch_evicted.assign(p ? sets*ways : 0, 0);
+}
+
+void cache_sim_t::prefetch_train(uint64_t addr, bool miss)
+{
+  uint64_t line = addr >> idx_shift;
+  bool trigger = miss;
+  if (miss) {
+    prefetched.erase(line);   // 先前 prefetch 的 line 已經被 clean_invalidate 清掉
+    uint64_t& evicted = prefetch_evicted[line % prefetch_evicted.size()];
+    if (evicted == line + 1) {
+      prefetches_polluting++;
+      evicted = 0;
+    }
+  }
+  else {
+    auto it = prefetched.find(line);
+    if (it != prefetched.end()) {   // 第一次使用 prefetched line
+      prefetches_useful++;
+      if (read_accesses + write_accesses - it->second < prefetch_latency)
+        prefetches_late++;
+      prefetched.erase(it);
+      trigger = true;
+    }
+  }
+
+  prefetch_lines.clear();
+  prefetcher->train(line, trigger, prefetch_lines);
+  for (size_t i = 0; i < prefetch_lines.size(); i++)
+    prefetch(prefetch_lines[i] << idx_shift);
+}
+
+void cache_sim_t::prefetch(uint64_t addr)
+{
+  size_t way;
+  if (check_tag(addr, way))   // 已經在 cache 中，不需要 prefetch
+    return;
+  if (side_kind == VICTIM_CACHE && side->touch(addr >> idx_shift))   // demand miss 時再從 victim cache 換回
+    return;
+
+  prefetches_issued++;
+  uint64_t victim = victimize(addr);   // 與 demand miss 相同的替換與寫回
+  if (victim & VALID) {
+    uint64_t block = victim & ~(VALID | DIRTY);
+    prefetched.erase(block);
+    prefetch_evicted[block % prefetch_evicted.size()] = block + 1;
+  }
+  evict(victim);
+  uint64_t line = addr >> idx_shift;
+  uint64_t& evicted = prefetch_evicted[line % prefetch_evicted.size()];
+  if (evicted == line + 1)
+    evicted = 0;
+  prefetched[line] = read_accesses + write_accesses;
+  if (miss_handler)
+    miss_handler->access(addr & ~(linesz-1), linesz, false);
+}
+
+void cache_sim_t::set_miss_handler(cache_sim_t* mh)
+{
+  miss_handler = mh;
+  if (mh)
+    mh->uppers.push_back(this);
+}
+
+void cache_sim_t::set_side_buffer(side_t kind, size_t entries)
+{
+  side_kind = kind;
+  side = new side_buffer_t(entries);
+}
+
+bool cache_sim_t::side_lookup(uint64_t addr, bool& dirty)
+{
+  uint64_t line = addr >> idx_shift;
+  bool hit;
+  if (side_kind == VICTIM_CACHE) {   // 與 cache 中的 victim 交換
+    bool was_dirty;
+    hit = side->take(line, was_dirty);
+    dirty |= hit && was_dirty;
+  }
+  else {                             // miss cache 保留一份 fetch 進來的 block
+    uint64_t out;
+    bool out_dirty;
+    hit = side->touch(line);
+    if (!hit)
+      side->put(line, false, out, out_dirty);
+  }
+  side_hits += hit;
+  return hit;
+}
+
+void cache_sim_t::set_classify()
+{
+  shadow = new fa_cache_sim_t(sets * ways, linesz, (name + " shadow").c_str(), fa_cache_sim_t::LRU);
+}
+
+void cache_sim_t::classify(uint64_t addr, bool miss)
+{
+  size_t way;
+  bool shadow_hit = shadow->check_tag(addr, way) != NULL;   // hash table 與 LRU list，都是 O(1)
+  if (shadow_hit)
+    shadow->on_hit(0, way);
+  else
+    shadow->victimize(addr);
+  if (!miss)
+    return;
+
+  if (touched.insert(addr >> idx_shift).second)
+    compulsory_misses++;
+  else if (!shadow_hit)
+    capacity_misses++;
+  else
+    conflict_misses++;
+}
+
+void cache_sim_t::evict(uint64_t victim)
+{
+  if (!(victim & VALID))
+    return;
+  if (side_kind == VICTIM_CACHE) {   // victim 放進 victim cache，被擠出來的才繼續往下處理
+    uint64_t line;
+    bool line_dirty;
+    writebacks_saved += (victim & DIRTY) != 0;
+    if (!side->put(victim & ~(VALID | DIRTY), victim & DIRTY, line, line_dirty))
+      return;
+    writebacks_saved -= line_dirty;
+    victim = line | VALID | (line_dirty ? DIRTY : 0);
+  }
+  uint64_t addr = (victim & ~(VALID | DIRTY)) << idx_shift;
+  bool dirty = victim & DIRTY;
+  if (inclusion == INCLUSIVE)
+    for (size_t i = 0; i < uppers.size(); i++)
+      dirty |= uppers[i]->back_invalidate(addr, linesz, back_invalidations);
+  bool exclusive_below = miss_handler && miss_handler->inclusion == EXCLUSIVE;
+  if (!dirty && !exclusive_below)
+    return;
+
+  if (dirty)
+    writebacks++;
+  if (exclusive_below)
+    miss_handler->insert_victim(addr, dirty);
+  else if (miss_handler)
+    miss_handler->access(addr, linesz, true);
+}
+
+bool cache_sim_t::back_invalidate(uint64_t addr, size_t bytes, uint64_t& lines)
+{
+  bool dirty = false;
+  for (uint64_t a = addr & ~(linesz-1); a < addr + bytes; a += linesz) {
+    size_t way;
+    if (!unsampled(set_index(a)) && check_tag(a, way)) {
+      size_t idx = set_index(a);
+      dirty |= test_bit(set_dirty(idx), way);
+      clear_bit(set_valid(idx), way);
+      clear_bit(set_dirty(idx), way);
+      lines++;
+    }
+    if (shadow)   // 被清除的 line 再 miss 時不算 conflict
+      shadow->clean_invalidate(a, linesz, false, true);
+    bool side_dirty;
+    if (side && side->take(a >> idx_shift, side_dirty)) {
+      dirty |= side_dirty;
+      if (side_dirty && side_kind == VICTIM_CACHE)   // 由下一層寫回
+        writebacks_saved--;
+      lines++;
+    }
+  }
+  for (size_t i = 0; i < uppers.size(); i++)   // 更上層的 copies 也要清除，不論中間那層是否 inclusive
+    dirty |= uppers[i]->back_invalidate(addr, bytes, lines);
+  return dirty;
+}
+
+void cache_sim_t::exclusive_access(uint64_t addr, size_t bytes, bool store)
+{
+  if (store) {    // 上層的寫回 (e.g. clean_invalidate)
+    insert_victim(addr & ~(linesz-1), true);
+    return;
+  }
+
+  read_accesses++;
+  bytes_read += bytes;
+  size_t way;
+  if (check_tag(addr, way)) {   // block 移到上層，dirty 的資料先寫回下一層
+    size_t idx = set_index(addr);
+    bool dirty = test_bit(set_dirty(idx), way);
+    clear_bit(set_valid(idx), way);
+    clear_bit(set_dirty(idx), way);
+    if (dirty)
+      evict((addr >> idx_shift) | VALID | DIRTY);
+    return;
+  }
+
+  read_misses++;
+  if (log)
+    std::cerr << name << " read miss 0x" << std::hex << addr << std::endl;
+  if (miss_handler)
+    miss_handler->access(addr & ~(linesz-1), linesz, false);
+}
+
+void cache_sim_t::insert_victim(uint64_t addr, bool dirty)
+{
+  victims_inserted++;
+  size_t way;
+  if (!check_tag(addr, way)) {    // I$ 與 D$ 可能都有同一個 block
+    evict(victimize(addr));
+    check_tag(addr, way);
+  }
+  if (dirty)
+    set_bit(set_dirty(set_index(addr)), way);
+}
+
+void cache_sim_t::print_stats() // 印出當前 cache 狀態資訊到螢幕上 
+{
+  uint64_t total[series_writer_t::FIELDS - 1];   // sampling 時為推估值
+  totals(total);
+  if (printed || total[2] + total[3] == 0)
+    return;
+  printed = true;
+
+  float mr = read_accesses + write_accesses ? 100.0f*(read_misses+write_misses)/(read_accesses+write_accesses) : 0.0f;  // miss rate
+
+  std::cout << std::setprecision(3) << std::fixed;
+  std::cout << name << " ";
+  std::cout << "Bytes Read:            " << total[0] << '\n';
+  std::cout << name << " ";
+  std::cout << "Bytes Written:         " << total[1] << '\n';
+  std::cout << name << " ";
+  std::cout << "Read Accesses:         " << total[2] << '\n';
+  std::cout << name << " ";
+  std::cout << "Write Accesses:        " << total[3] << '\n';
+  std::cout << name << " ";
+  std::cout << "Read Misses:           " << total[4] << '\n';
+  std::cout << name << " ";
+  std::cout << "Write Misses:          " << total[5] << '\n';
+  std::cout << name << " ";
+  std::cout << "Writebacks:            " << total[6] << '\n';
+  std::cout << name << " ";
+  std::cout << "Miss Rate:             " << mr << "%\n";
+  if (sample_period) {
+    double ci = miss_rate_ci95();
+    std::cout << name << " ";
+    std::cout << "Miss Rate 95% CI:      ";
+    if (ci < 0)
+      std::cout << "n/a\n";
+    else
+      std::cout << "+-" << ci << "% (" << std::max(0.0, mr - ci) << "% to " << std::min(100.0, mr + ci) << "%)\n";
+    std::cout << name << " ";
+    std::cout << "Sampled Sets:          " << sample_accesses.size() << " of " << sets << '\n';
+  }
+  if (prefetcher) {
+    std::cout << name << " ";
+    std::cout << "Prefetches Issued:     " << scaled(prefetches_issued) << '\n';
+    std::cout << name << " ";
+    std::cout << "Prefetches Useful:     " << scaled(prefetches_useful) << '\n';
+    std::cout << name << " ";
+    std::cout << "Prefetches Late:       " << scaled(prefetches_late) << '\n';
+    std::cout << name << " ";
+    std::cout << "Prefetches Polluting:  " << scaled(prefetches_polluting) << '\n';
+  }
+  if (inclusion == INCLUSIVE) {
+    std::cout << name << " ";
+    std::cout << "Back Invalidations:    " << back_invalidations << '\n';
+  }
+  if (inclusion == EXCLUSIVE) {
+    std::cout << name << " ";
+    std::cout << "Victims Inserted:      " << victims_inserted << '\n';
+  }
+  if (shadow) {
+    std::cout << name << " ";
+    std::cout << "Compulsory Misses:     " << compulsory_misses << '\n';
+    std::cout << name << " ";
+    std::cout << "Capacity Misses:       " << capacity_misses << '\n';
+    std::cout << name << " ";
+    std::cout << "Conflict Misses:       " << conflict_misses << '\n';
+  }
+  if (side) {
+    // 沒有 side buffer 時 side buffer 命中的 misses 也要 fetch，留在 victim cache 中的 dirty blocks 也要寫回
+    uint64_t traffic = read_misses + write_misses - side_hits + writebacks;
+    uint64_t without = traffic + side_hits + writebacks_saved;
+    std::cout << name << " ";
+    std::cout << (side_kind == VICTIM_CACHE ? "Victim Cache Hits:     " : "Miss Cache Hits:       ") << side_hits << '\n';
+    std::cout << name << " ";
+    std::cout << "Next Level Traffic:    " << traffic * linesz << " bytes";
+    if (without)
+      std::cout << " (-" << 100.0 * (without - traffic) / without << "%)";
+    std::cout << '\n';
+  }
+  print_policy_stats();
+  std::cout.flush();
+}
+
+uint64_t* cache_sim_t::check_tag(uint64_t addr, size_t& way) 
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);  // 相當於 (block address) % (sets number)，求出在哪一個 set index， (addr >> idx_shift)是在求 block address
+  uint64_t tag = addr >> idx_shift;             // tag 值即為 block address，valid/dirty 位元另外存在 bitmask 中，比對時不需要 mask
+  uint64_t* tags = set_tags(idx);
+  uint64_t valid = set_valid(idx)[0];
+
+  if (match_tags) {                             // 一次比對整個 set，只留下 valid 的 way
+    uint64_t match = match_tags(tags, tag_slots, tag) & valid;
+    if (!match)
+      return NULL;  // cache miss
+    way = __builtin_ctzll(match);
+    return &tags[way];                          // cache hit
+  }
+
+  for (size_t i = 0; i < ways; i++)             // 在 selected set 中的各 ways 中尋找是否有符合的 tag 
+    if (tag == tags[i] && ((valid >> i) & 1)) {
+      way = i;
+      return &tags[i];                          // cache hit
+    }
+
+  return NULL;  // cache miss
+}
+
+uint64_t cache_sim_t::replace(size_t idx, size_t way, uint64_t addr)
+{
+  uint64_t* tags = set_tags(idx);
+  uint64_t victim = tags[way];                  // 舊的 block 連同 VALID/DIRTY 位元一起回傳
+  if (test_bit(set_valid(idx), way))
+    victim |= VALID;
+  if (test_bit(set_dirty(idx), way))
+    victim |= DIRTY;
+
+  tags[way] = addr >> idx_shift;                // 把 data address 的 tag 寫入 victim block 原本的位置
+  set_bit(set_valid(idx), way);
+  clear_bit(set_dirty(idx), way);
+  return victim;
+}
+
+uint64_t cache_sim_t::victimize(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);  // 求出需要寫入的 data address 在哪一個 set index
+  size_t way = lfsr.next() % ways;              // 隨機選取其中一個 way 作為 victim block
+  return replace(idx, way, addr);
+}
+
+void cache_sim_t::access(uint64_t addr, size_t bytes, bool store)
+{
+  if (unlikely(inclusion == EXCLUSIVE)) {
+    exclusive_access(addr, bytes, store);
+    return;
+  }
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  if (unlikely(sample_period != 0) && !sample(idx, bytes, store))
+    return;
+  if (unlikely(series_left != 0) && --series_left == 0) {   // 已經完成一個 interval 的 accesses
+    snapshot(read_accesses + write_accesses);
+    series_left = series_period;
+  }
+
+  store ? write_accesses++ : read_accesses++;     // increment the 'write_accesses' counter if store is true (indicating a write operation)
+  (store ? bytes_written : bytes_read) += bytes;  // increment the appropriate bytes counters based on whether the access is a write or a read 
+
+  size_t way;
+  uint64_t* hit_way = check_tag(addr, way);
+  if (likely(hit_way != NULL))  // cache hit
+  {    
+    on_hit(idx, way);            // let the replacement policy update its state, no need to search the set again
+    if (store)   // set DIRTY bit if cache hit and write_accesses
+      set_bit(set_dirty(idx), way);
+    if (unlikely(shadow != NULL))
+      classify(addr, false);
+    if (unlikely(prefetcher != NULL))
+      prefetch_train(addr, false);
+    return;
+  }
+
+  store ? write_misses++ : read_misses++; // what kind of cache miss, increments the appropriate miss counter 
+  if (unlikely(shadow != NULL))
+    classify(addr, true);
+  if (unlikely(sample_period != 0))
+    sample_misses[sample_slot[idx]]++;
+  if (log)  //  cache miss and outputs a message to the console if the `log` flag is set
+  {
+    std::cerr << name << " "
+              << (store ? "write" : "read") << " miss 0x"
+              << std::hex << addr << std::endl;
+  }
+
+  uint64_t victim = victimize(addr);  // select a victim block to be replaced, using cache replacement policy
+  if (unlikely(prefetcher != NULL) && (victim & VALID))
+    prefetched.erase(victim & ~(VALID | DIRTY));    // evicted before it was used
+  bool dirty = store;
+  bool buffered = unlikely(side != NULL) && side_lookup(addr, dirty);   // 先取出，victim 才能換進它的位置
+  evict(victim);                      // if the victim block is valid and dirty, write back to memory
+
+  if (miss_handler && !buffered)
+    miss_handler->access(addr & ~(linesz-1), linesz, false);
+
+  if (dirty && check_tag(addr, way))
+    set_bit(set_dirty(idx), way);
+
+  if (unlikely(prefetcher != NULL))
+    prefetch_train(addr, true);
+}
+
+// Same as calling access() on every reference in order, but the counters stay in locals and the
+// misses are handed to the next level as one batch at the end. Every level still sees its
+// references in the original order, so as long as a batch holds a contiguous run of the stream the
+// results are identical to access(), even with an L2 shared by I$ and D$.
+void cache_sim_t::access_batch(const mem_ref* refs, size_t n)
+{
+  // interval 可能在 batch 中間結束，sampling、prefetch 與 inclusion 要逐一處理；
+  // 下面有 inclusive/exclusive 的層時 misses 不能延到 batch 結束才送出，它們會回頭改變上層
+  bool ordered = inclusion != NINE;
+  for (cache_sim_t* c = miss_handler; c && !ordered; c = c->miss_handler)
+    ordered = c->inclusion != NINE;
+  if (unlikely(series_left != 0 || sample_period != 0 || prefetcher != NULL || side != NULL || shadow != NULL || ordered)) {
+    for (const mem_ref* r = refs; r != refs + n; r++)
+      access(r->addr, r->bytes, r->store);
+    return;
+  }
+
+  uint64_t reads = 0, writes = 0, rbytes = 0, wbytes = 0;
+  uint64_t rmisses = 0, wmisses = 0, wbs = 0;
+  miss_refs.clear();
+
+  for (const mem_ref* r = refs; r != refs + n; r++)
+  {
+    uint64_t addr = r->addr;
+    bool store = r->store;
+    store ? writes++ : reads++;
+    (store ? wbytes : rbytes) += r->bytes;
+
+    size_t idx = (addr >> idx_shift) & (sets-1);
+    size_t way;
+    if (likely(check_tag(addr, way) != NULL))   // cache hit
+    {
+      on_hit(idx, way);
+      if (store)
+        set_bit(set_dirty(idx), way);
+      continue;
+    }
+
+    store ? wmisses++ : rmisses++;
+    if (log)
+    {
+      std::cerr << name << " "
+                << (store ? "write" : "read") << " miss 0x"
+                << std::hex << addr << std::endl;
+    }
+
+    uint64_t victim = victimize(addr);
+    if ((victim & (VALID | DIRTY)) == (VALID | DIRTY))
+    {
+      if (miss_handler)
+        miss_refs.push_back(mem_ref{(victim & ~(VALID | DIRTY)) << idx_shift, uint32_t(linesz), true});
+      wbs++;
+    }
+    if (miss_handler)
+      miss_refs.push_back(mem_ref{addr & ~(linesz-1), uint32_t(linesz), false});
+
+    if (store && check_tag(addr, way))
+      set_bit(set_dirty(idx), way);
+  }
+
+  read_accesses += reads;
+  write_accesses += writes;
+  bytes_read += rbytes;
+  bytes_written += wbytes;
+  read_misses += rmisses;
+  write_misses += wmisses;
+  writebacks += wbs;
+
+  if (miss_handler && !miss_refs.empty())
+    miss_handler->access_batch(miss_refs.data(), miss_refs.size());
+}
+
+void cache_sim_t::clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool inval)
+{
+  uint64_t start_addr = addr & ~(linesz-1);
+  uint64_t end_addr = (addr + bytes + linesz-1) & ~(linesz-1);
+  uint64_t cur_addr = start_addr;
+  while (cur_addr < end_addr) {
+    size_t idx = (cur_addr >> idx_shift) & (sets-1);
+    size_t way;
+    uint64_t* hit_way = unsampled(idx) ? NULL : check_tag(cur_addr, way);   // 沒有 sampled 的 sets 沒有 blocks
+    if (likely(hit_way != NULL))
+    {
+      if (clean) {
+        if (test_bit(set_dirty(idx), way)) {
+          writebacks++;
+          clear_bit(set_dirty(idx), way);
+        }
+      }
+
+      if (inval)
+        clear_bit(set_valid(idx), way);
+    }
+    if (shadow && inval)
+      shadow->clean_invalidate(cur_addr, linesz, false, true);
+    if (side) {
+      bool dirty;
+      if (clean && side->clean(cur_addr >> idx_shift)) {
+        writebacks++;
+        writebacks_saved--;
+      }
+      if (inval)
+        side->take(cur_addr >> idx_shift, dirty);
+    }
+    cur_addr += linesz;
+  }
+  if (miss_handler)
+    miss_handler->clean_invalidate(addr, bytes, clean, inval);
+}
+
+// FIFO
+fifo_cache_sim_t::fifo_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name)
+  : cache_sim_t(sets, ways, linesz, name, ways*sizeof(uint64_t)), time(0)
+{
+  // 與 baseline 相同，empty ways 的 'enter_time' 也是 0，所以第一個填入的 block (time 0) 和它們平手，
+  // 它的 set 下一次 miss 時替換它 (way 0)，之後的 blocks 從 1 開始，empty ways 才會先被使用
+}
+
+uint64_t fifo_cache_sim_t::victimize(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  uint64_t* enter_time = (uint64_t*)set_meta(idx);   // 'enter_time' record the first time of block to enter the cache
+
+  size_t victim_way = 0;    // set the first way to be the victim way first
+  for (size_t i = 1; i < ways; i++)
+    if (enter_time[i] < enter_time[victim_way])     // find the block has the earliest 'enter_time' to be the victim
+      victim_way = i;
+  enter_time[victim_way] = time++;                  // give the 'time' to the 'enter_time' of new block
+
+  return replace(idx, victim_way, addr);
+}
+
+// LRU, the metadata of a set is a circular doubly linked list of its ways ordered from MRU to LRU:
+// one byte for the MRU way, then one 'prev' byte and one 'next' byte per way
+lru_cache_sim_t::lru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name)
+  : cache_sim_t(sets, ways, linesz, name, 1 + 2*ways), zero_set(NONE), started(false)
+{
+  for (size_t idx = 0; idx < sets; idx++) {
+    uint8_t* mru = set_meta(idx);
+    uint8_t* prev = mru + 1;
+    uint8_t* next = prev + ways;
+    for (size_t i = 0; i < ways; i++) {
+      prev[i] = (i + ways - 1) % ways;
+      next[i] = (i + 1) % ways;
+    }
+    *mru = 0;
+  }
+}
+
+void lru_cache_sim_t::touch(size_t idx, size_t way)
+{
+  uint8_t* mru = set_meta(idx);
+  uint8_t* prev = mru + 1;
+  uint8_t* next = prev + ways;
+
+  if (way == *mru)
+    return;
+  if (way != prev[*mru]) {      // unlink 'way' and insert it in front of the MRU way
+    next[prev[way]] = next[way];
+    prev[next[way]] = prev[way];
+    uint8_t lru = prev[*mru];
+    next[lru] = way;
+    prev[way] = lru;
+    next[way] = *mru;
+    prev[*mru] = way;
+  }                             // the LRU way is already in front of the MRU way in the circular list
+  *mru = way;
+}
+
+uint64_t lru_cache_sim_t::victimize(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  uint8_t* mru = set_meta(idx);
+  uint64_t invalid = ~set_valid(idx)[0] & (~0ULL >> (64 - ways));
+
+  size_t victim_way = idx == zero_set ? 0                   // the untouched first block ties with the empty ways
+                    : invalid ? __builtin_ctzll(invalid)    // fill the empty ways first, lowest way first
+                    : mru[1 + *mru];                        // otherwise the LRU way, which is prev[MRU]
+  zero_set = !started ? idx : idx == zero_set ? NONE : zero_set;
+  started = true;
+  touch(idx, victim_way);
+  return replace(idx, victim_way, addr);
+}
+
+void lru_cache_sim_t::on_hit(size_t idx, size_t way)
+{
+  if (unlikely(idx == zero_set) && way == 0)
+    zero_set = NONE;
+  touch(idx, way);              // the block becomes the MRU block of its set
+}
+
+// LFU, the blocks of a set are kept in frequency buckets ordered by use count, so the least
+// frequently used block is always in the first bucket. A bucket holds a bitmask of its ways (LFU
+// ties go to the lowest way) and a list of its ways from LRU to MRU (LFRU ties go to the LRU way).
+lfu_cache_sim_t::lfu_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name,
+                                 uint64_t _sat, uint64_t _age_period, bool _lru_ties)
+  : cache_sim_t(sets, ways, linesz, name, ways*sizeof(bucket_t) + sizeof(header_t) + ways*sizeof(way_t)),
+    sat(_sat), age_period(_age_period), age_count(0), epoch(0), lru_ties(_lru_ties)
+{
+  for (size_t idx = 0; idx < sets; idx++) {
+    bucket_t* bucket = buckets(idx);
+    for (size_t i = 0; i < ways; i++) {   // every bucket starts on the free list, no way is in a bucket
+      bucket[i].next = i + 1 < ways ? i + 1 : NIL;
+      way_links(idx)[i].bucket = NIL;
+    }
+    header(idx)->first = NIL;
+    header(idx)->free = 0;
+    header(idx)->epoch = 0;
+  }
+}
+
+void lfu_cache_sim_t::bucket_add(size_t idx, uint8_t b, size_t way)
+{
+  bucket_t* bucket = buckets(idx);
+  way_t* w = way_links(idx);
+  w[way].bucket = b;
+  w[way].prev = bucket[b].last;
+  w[way].next = NIL;
+  if (bucket[b].last != NIL)
+    w[bucket[b].last].next = way;
+  else
+    bucket[b].first = way;
+  bucket[b].last = way;
+  bucket[b].mask |= 1ULL << way;
+}
+
+void lfu_cache_sim_t::bucket_remove(size_t idx, size_t way)
+{
+  bucket_t* bucket = buckets(idx);
+  way_t* w = way_links(idx);
+  uint8_t b = w[way].bucket;
+  (w[way].prev != NIL ? w[w[way].prev].next : bucket[b].first) = w[way].next;
+  (w[way].next != NIL ? w[w[way].next].prev : bucket[b].last) = w[way].prev;
+  bucket[b].mask &= ~(1ULL << way);
+  w[way].bucket = NIL;
+  if (bucket[b].mask == 0)                // the bucket is empty, unlink it and return it to the free list
+  {
+    header_t* h = header(idx);
+    (bucket[b].prev != NIL ? bucket[bucket[b].prev].next : h->first) = bucket[b].next;
+    if (bucket[b].next != NIL)
+      bucket[bucket[b].next].prev = bucket[b].prev;
+    bucket[b].next = h->free;
+    h->free = b;
+  }
+}
+
+uint8_t lfu_cache_sim_t::bucket_new(size_t idx, uint8_t prev, uint32_t freq)
+{
+  bucket_t* bucket = buckets(idx);
+  header_t* h = header(idx);
+  uint8_t b = h->free;                    // there are never more buckets in use than ways
+  h->free = bucket[b].next;
+  bucket[b].freq = freq;
+  bucket[b].mask = 0;
+  bucket[b].first = bucket[b].last = NIL;
+  bucket[b].prev = prev;
+  uint8_t& link = prev != NIL ? bucket[prev].next : h->first;
+  bucket[b].next = link;
+  if (link != NIL)
+    bucket[link].prev = b;
+  link = b;
+  return b;
+}
+
+void lfu_cache_sim_t::age(size_t idx)
+{
+  header_t* h = header(idx);
+  if (h->epoch == epoch)
+    return;
+  uint32_t shift = epoch - h->epoch < 32 ? epoch - h->epoch : 32;
+  h->epoch = epoch;
+
+  // halve the counts of every bucket, the order is kept so only neighbouring buckets can merge
+  bucket_t* bucket = buckets(idx);
+  way_t* w = way_links(idx);
+  uint8_t kept = NIL;
+  for (uint8_t b = h->first; b != NIL; ) {
+    uint8_t next = bucket[b].next;
+    uint32_t freq = std::max<uint32_t>(1, (uint64_t)bucket[b].freq >> shift);
+    if (kept != NIL && bucket[kept].freq == freq)
+    {
+      for (uint8_t i = bucket[b].first; i != NIL; i = w[i].next)
+        w[i].bucket = kept;
+      w[bucket[kept].last].next = bucket[b].first;    // appended on the MRU side, so the merged blocks count as more recent
+      w[bucket[b].first].prev = bucket[kept].last;
+      bucket[kept].last = bucket[b].last;
+      bucket[kept].mask |= bucket[b].mask;
+      bucket[kept].next = next;
+      if (next != NIL)
+        bucket[next].prev = kept;
+      bucket[b].next = h->free;
+      h->free = b;
+    }
+    else
+    {
+      bucket[b].freq = freq;
+      kept = b;
+    }
+    b = next;
+  }
+}
+
+void lfu_cache_sim_t::tick()
+{
+  if (age_period && ++age_count == age_period) {
+    age_count = 0;
+    epoch++;
+  }
+}
+
+uint64_t lfu_cache_sim_t::victimize(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  tick();
+  age(idx);
+
+  uint64_t invalid = ~set_valid(idx)[0] & (~0ULL >> (64 - ways));
+  size_t victim_way;
+  if (invalid)
+  {
+    victim_way = __builtin_ctzll(invalid);    // fill the empty ways first, lowest way first
+    if (way_links(idx)[victim_way].bucket != NIL)   // an invalidated block still sits in its bucket
+      bucket_remove(idx, victim_way);
+  }
+  else
+  {
+    const bucket_t& least = buckets(idx)[header(idx)->first];
+    victim_way = lru_ties ? least.first : __builtin_ctzll(least.mask);
+    bucket_remove(idx, victim_way);
+  }
+
+  // the new block has been used once
+  uint8_t first = header(idx)->first;
+  bucket_add(idx, first != NIL && buckets(idx)[first].freq == 1 ? first : bucket_new(idx, NIL, 1), victim_way);
+
+  return replace(idx, victim_way, addr);
+}
+
+void lfu_cache_sim_t::on_hit(size_t idx, size_t way)
+{
+  tick();
+  age(idx);
+
+  bucket_t* bucket = buckets(idx);
+  uint8_t b = way_links(idx)[way].bucket;
+  uint32_t freq = bucket[b].freq;
+  if (freq >= sat)                        // the count is saturated, only the recency changes
+  {
+    if (bucket[b].last != way) {
+      bucket_remove(idx, way);
+      bucket_add(idx, b, way);
+    }
+    return;
+  }
+
+  uint8_t next = bucket[b].next;
+  if (next == NIL || bucket[next].freq != freq + 1)
+  {
+    if (bucket[b].first == bucket[b].last) {  // the block is alone in its bucket, the bucket moves up with it
+      bucket[b].freq = freq + 1;
+      return;
+    }
+    next = bucket_new(idx, b, freq + 1);
+  }
+  bucket_remove(idx, way);
+  bucket_add(idx, next, way);
+}
+
+// LFRU, same buckets as LFU but ties are broken by recency
+lfru_cache_sim_t::lfru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name, uint64_t sat, uint64_t age_period)
+  : lfu_cache_sim_t(sets, ways, linesz, name, sat, age_period, true)
+{
+}
+
+// tree-PLRU, the metadata of a set is one 64-bit word holding the tree nodes 1..ways-1 as a heap,
+// a node bit of 0 means the PLRU way is in its left subtree, 1 means the right subtree
+plru_cache_sim_t::plru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name)
+  : cache_sim_t(sets, ways, linesz, name, sizeof(uint64_t))
+{
+}
+
+void plru_cache_sim_t::touch(size_t idx, size_t way)
+{
+  uint64_t& tree = *(uint64_t*)set_meta(idx);
+  for (size_t node = way + ways; node > 1; node >>= 1)    // a left child makes its parent point right and vice versa
+    tree = (tree & ~(1ULL << (node >> 1))) | ((uint64_t)(~node & 1) << (node >> 1));
+}
+
+uint64_t plru_cache_sim_t::victimize(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  uint64_t tree = *(uint64_t*)set_meta(idx);
+  uint64_t invalid = ~set_valid(idx)[0] & (~0ULL >> (64 - ways));
+
+  size_t node = 1;
+  while (node < ways)                   // follow the node bits down to a leaf
+    node = 2*node + ((tree >> node) & 1);
+  size_t victim_way = invalid ? __builtin_ctzll(invalid) : node - ways;
+
+  touch(idx, victim_way);
+  return replace(idx, victim_way, addr);
+}
+
+void plru_cache_sim_t::on_hit(size_t idx, size_t way)
+{
+  touch(idx, way);
+}
+
+// bit-PLRU, the metadata of a set is one 64-bit word with the MRU bit of every way
+bit_plru_cache_sim_t::bit_plru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name)
+  : cache_sim_t(sets, ways, linesz, name, sizeof(uint64_t))
+{
+}
+
+void bit_plru_cache_sim_t::touch(size_t idx, size_t way)
+{
+  if (ways == 1)                        // direct-mapped: no MRU state, way 0 is always the victim
+    return;
+  uint64_t& mru = *(uint64_t*)set_meta(idx);
+  uint64_t all = ~0ULL >> (64 - ways);
+  mru |= 1ULL << way;
+  if (mru == all)                       // every way is marked, keep only the one just used
+    mru = 1ULL << way;
+}
+
+uint64_t bit_plru_cache_sim_t::victimize(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  uint64_t mru = *(uint64_t*)set_meta(idx);
+  uint64_t all = ~0ULL >> (64 - ways);
+  uint64_t invalid = ~set_valid(idx)[0] & all;
+
+  size_t victim_way = ways == 1 ? 0 : __builtin_ctzll(invalid ? invalid : ~mru & all);   // never all marked, see touch()
+
+  touch(idx, victim_way);
+  return replace(idx, victim_way, addr);
+}
+
+void bit_plru_cache_sim_t::on_hit(size_t idx, size_t way)
+{
+  touch(idx, way);
+}
+
+// RRIP
+rrip_cache_sim_t::rrip_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name, mode_t _mode,
+                                   size_t _rrpv_bits, uint64_t _bip_period)
+  : cache_sim_t(sets, ways, linesz, name, _rrpv_bits*sizeof(uint64_t)), mode(_mode), rrpv_bits(_rrpv_bits),
+    rrpv_max((1ULL << _rrpv_bits) - 1), bip_period(_bip_period), bip_count(0),
+    psel((PSEL_MAX + 1) / 2), follower_srrip(0), follower_brrip(0)
+{
+  // one SRRIP leader and one BRRIP leader in every group of sets, 32 groups once the cache is large enough
+  leader_mask = (sets >= 128 ? sets / 32 : 4) - 1;
+}
+
+void rrip_cache_sim_t::print_policy_stats()
+{
+  if (mode != DRRIP)
+    return;
+  std::cout << name << " ";
+  std::cout << "DRRIP PSEL:            " << psel << " (" << (psel > PSEL_MAX / 2 ? "BRRIP" : "SRRIP") << ")\n";
+  std::cout << name << " ";
+  std::cout << "DRRIP SRRIP Inserts:   " << follower_srrip << '\n';
+  std::cout << name << " ";
+  std::cout << "DRRIP BRRIP Inserts:   " << follower_brrip << '\n';
+}
+
+void rrip_cache_sim_t::policy_stats(stats_record_t& record)
+{
+  if (mode != DRRIP)
+    return;
+  record.add("drrip_psel", uint64_t(psel));
+  record.add("drrip_srrip_inserts", follower_srrip);
+  record.add("drrip_brrip_inserts", follower_brrip);
+}
+
+void rrip_cache_sim_t::set_rrpv(size_t idx, size_t way, uint64_t rrpv)
+{
+  uint64_t* p = planes(idx);
+  for (size_t k = 0; k < rrpv_bits; k++)
+    p[k] = (p[k] & ~(1ULL << way)) | (((rrpv >> k) & 1) << way);
+}
+
+bool rrip_cache_sim_t::brrip_insert(size_t idx)
+{
+  if (mode != DRRIP)
+    return mode == BRRIP;
+
+  size_t group = idx & leader_mask;
+  if (group == 0)                       // SRRIP leader
+    return false;
+  if (group == leader_mask)             // BRRIP leader
+    return true;
+  bool brrip = psel > PSEL_MAX / 2;     // followers use the policy whose leaders miss less
+  (brrip ? follower_brrip : follower_srrip)++;
+  return brrip;
+}
+
+uint64_t rrip_cache_sim_t::victimize(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  uint64_t* p = planes(idx);
+  uint64_t all = ~0ULL >> (64 - ways);
+  uint64_t invalid = ~set_valid(idx)[0] & all;
+
+  if (mode == DRRIP) {                  // every miss in a leader set votes against its policy
+    size_t group = idx & leader_mask;
+    if (group == 0 && psel < PSEL_MAX)
+      psel++;
+    else if (group == leader_mask && psel > 0)
+      psel--;
+  }
+
+  size_t victim_way;
+  if (invalid)
+    victim_way = __builtin_ctzll(invalid);
+  else
+  {
+    uint64_t distant;
+    for (;;) {
+      distant = all;                    // ways whose RRPV has every bit set
+      for (size_t k = 0; k < rrpv_bits; k++)
+        distant &= p[k];
+      if (distant)
+        break;
+      uint64_t carry = all;             // no way is distant yet, increment every RRPV by one
+      for (size_t k = 0; k < rrpv_bits; k++) {
+        uint64_t c = p[k] & carry;
+        p[k] ^= carry;
+        carry = c;
+      }
+    }
+    victim_way = __builtin_ctzll(distant);
+  }
+
+  uint64_t rrpv = rrpv_max - 1;         // SRRIP: long re-reference interval
+  if (brrip_insert(idx) && ++bip_count % bip_period != 0)
+    rrpv = rrpv_max;                    // BRRIP: distant, except one in 'bip_period' insertions
+  set_rrpv(idx, victim_way, rrpv);
+  return replace(idx, victim_way, addr);
+}
+
+void rrip_cache_sim_t::on_hit(size_t idx, size_t way)
+{
+  set_rrpv(idx, way, 0);                // hit priority: predict a near re-reference
+}
+
+// fully associative cache, a hash table finds the slot of a block and the replacement state is
+// kept in intrusive lists of slots, so both lookup and eviction are O(1) for any number of ways
+fa_cache_sim_t::fa_cache_sim_t(size_t ways, size_t linesz, const char* name, policy_t _policy,
+                               uint64_t _sat, uint64_t _age_period, size_t rrpv_bits, uint64_t _bip_period)
+  : cache_sim_t(1, ways, linesz, name), prev(ways), next(ways),
+    rrpv_max((1ULL << rrpv_bits) - 1), rrip_base(0), bip_period(_bip_period), bip_count(0),
+    policy(_policy), used(0), first(NIL), last(NIL), lru_started(false), first_untouched(false), sat(_sat), age_period(_age_period), age_count(0)
+{
+  size_t capacity = 16;
+  while (capacity < 2*ways)   // keep the load factor at most 1/2
+    capacity *= 2;
+  keys.resize(capacity);
+  vals.assign(capacity, uint32_t(NIL));
+  hash_mask = capacity - 1;
+
+  if (policy == PLRU)
+    plru_tree.assign(ways, 0);
+  if (policy == SRRIP || policy == BRRIP) {
+    rrip_first.assign(rrpv_max + 1, uint32_t(NIL));
+    rrip_last.assign(rrpv_max + 1, uint32_t(NIL));
+    rrip_list.resize(ways);
+  }
+  if (policy == BIT_PLRU) {
+    mru_bits.assign((ways + 63) / 64, 0);
+    mru_count = 0;
+  }
+
+  if (policy == LFU || policy == LFRU) {
+    buckets.resize(ways);
+    slot_bucket.assign(ways, uint32_t(NIL));
+    for (size_t i = 0; i < ways; i++)
+      buckets[i].next = i + 1 < ways ? i + 1 : NIL;
+    first_bucket = NIL;
+    free_bucket = 0;
+  }
+  if (policy == LFU) {
+    for (lfu_leaves = 1; lfu_leaves < ways; lfu_leaves *= 2)
+      ;
+    lfu_tree.assign(2*lfu_leaves, UINT64_MAX);
+  }
+}
+
+uint32_t fa_cache_sim_t::lookup(uint64_t line) const
+{
+  for (size_t i = hash_pos(line); vals[i] != NIL; i = (i + 1) & hash_mask)
+    if (keys[i] == line)
+      return vals[i];
+  return NIL;
+}
+
+void fa_cache_sim_t::insert(uint64_t line, uint32_t slot)
+{
+  size_t i = hash_pos(line);
+  while (vals[i] != NIL && keys[i] != line)
+    i = (i + 1) & hash_mask;
+  keys[i] = line;
+  vals[i] = slot;
+}
+
+void fa_cache_sim_t::erase(uint64_t line)
+{
+  size_t i = hash_pos(line);
+  while (keys[i] != line || vals[i] == NIL)
+    i = (i + 1) & hash_mask;
+  vals[i] = NIL;
+
+  // shift back the following entries of the probe run, so no tombstones are needed
+  for (size_t j = (i + 1) & hash_mask; vals[j] != NIL; j = (j + 1) & hash_mask) {
+    size_t home = hash_pos(keys[j]);
+    if (((j - home) & hash_mask) >= ((j - i) & hash_mask)) {   // 'i' lies between the home of the entry and 'j'
+      keys[i] = keys[j];
+      vals[i] = vals[j];
+      vals[j] = NIL;
+      i = j;
+    }
+  }
+}
+
+void fa_cache_sim_t::list_append(uint32_t& first, uint32_t& last, uint32_t slot)
+{
+  prev[slot] = last;
+  next[slot] = NIL;
+  (last != NIL ? next[last] : first) = slot;
+  last = slot;
+}
+
+void fa_cache_sim_t::list_remove(uint32_t& first, uint32_t& last, uint32_t slot)
+{
+  (prev[slot] != NIL ? next[prev[slot]] : first) = next[slot];
+  (next[slot] != NIL ? prev[next[slot]] : last) = prev[slot];
+}
+
+uint32_t fa_cache_sim_t::bucket_new(uint32_t after, uint64_t freq)
+{
+  uint32_t b = free_bucket;
+  free_bucket = buckets[b].next;
+  buckets[b].freq = freq;
+  buckets[b].first = buckets[b].last = NIL;
+  buckets[b].prev = after;
+  uint32_t& link = after != NIL ? buckets[after].next : first_bucket;
+  buckets[b].next = link;
+  if (link != NIL)
+    buckets[link].prev = b;
+  link = b;
+  return b;
+}
+
+void fa_cache_sim_t::bucket_remove(uint32_t slot)
+{
+  uint32_t b = slot_bucket[slot];
+  list_remove(buckets[b].first, buckets[b].last, slot);
+  slot_bucket[slot] = NIL;
+  if (buckets[b].first == NIL) {
+    (buckets[b].prev != NIL ? buckets[buckets[b].prev].next : first_bucket) = buckets[b].next;
+    if (buckets[b].next != NIL)
+      buckets[buckets[b].next].prev = buckets[b].prev;
+    buckets[b].next = free_bucket;
+    free_bucket = b;
+  }
+}
+
+void fa_cache_sim_t::lfu_update(uint32_t slot)
+{
+  size_t i = slot + lfu_leaves;
+  lfu_tree[i] = slot_bucket[slot] == NIL ? UINT64_MAX : buckets[slot_bucket[slot]].freq << 32 | slot;
+  for (i >>= 1; i > 0; i >>= 1)
+    lfu_tree[i] = std::min(lfu_tree[2*i], lfu_tree[2*i + 1]);
+}
+
+void fa_cache_sim_t::age()
+{
+  // halve the counts of every bucket and merge neighbouring buckets that end up with the same count
+  uint32_t kept = NIL;
+  for (uint32_t b = first_bucket; b != NIL; ) {
+    uint32_t nb = buckets[b].next;
+    uint64_t freq = std::max<uint64_t>(1, buckets[b].freq >> 1);
+    if (kept != NIL && buckets[kept].freq == freq) {
+      for (uint32_t i = buckets[b].first; i != NIL; i = next[i])
+        slot_bucket[i] = kept;
+      next[buckets[kept].last] = buckets[b].first;
+      prev[buckets[b].first] = buckets[kept].last;
+      buckets[kept].last = buckets[b].last;
+      buckets[kept].next = nb;
+      if (nb != NIL)
+        buckets[nb].prev = kept;
+      buckets[b].next = free_bucket;
+      free_bucket = b;
+    } else {
+      buckets[b].freq = freq;
+      kept = b;
+    }
+    b = nb;
+  }
+  if (policy == LFU)
+    for (uint32_t slot = 0; slot < used; slot++)
+      lfu_update(slot);
+}
+
+void fa_cache_sim_t::plru_touch(uint32_t slot)
+{
+  if (policy == PLRU) {
+    for (size_t node = slot + ways; node > 1; node >>= 1)
+      plru_tree[node >> 1] = ~node & 1;
+  } else if (policy == BIT_PLRU && !test_bit(mru_bits.data(), slot)) {
+    set_bit(mru_bits.data(), slot);
+    if (++mru_count == ways) {          // every slot is marked, keep only the one just used
+      std::fill(mru_bits.begin(), mru_bits.end(), 0);
+      set_bit(mru_bits.data(), slot);
+      mru_count = 1;
+    }
+  }
+}
+
+void fa_cache_sim_t::rrip_move(uint32_t slot, uint64_t rrpv)
+{
+  uint32_t l = rrip_list[slot];
+  list_remove(rrip_first[l], rrip_last[l], slot);
+  l = rrip_index(rrpv);
+  list_append(rrip_first[l], rrip_last[l], slot);
+  rrip_list[slot] = l;
+}
+
+uint64_t* fa_cache_sim_t::check_tag(uint64_t addr, size_t& way)
+{
+  uint32_t slot = lookup(addr >> idx_shift);
+  if (slot == NIL || !test_bit(set_valid(0), slot))
+    return NULL;
+  way = slot;
+  return &set_tags(0)[way];
+}
+
+void fa_cache_sim_t::on_hit(size_t UNUSED idx, size_t way)
+{
+  if (policy == PLRU || policy == BIT_PLRU)
+    plru_touch(way);
+  else if (policy == SRRIP || policy == BRRIP)
+    rrip_move(way, 0);
+  else if (policy == LRU) {
+    if (way == 0)
+      first_untouched = false;
+    list_remove(first, last, way);
+    list_append(first, last, way);
+  } else if (policy == LFU || policy == LFRU) {
+    if (age_period && ++age_count == age_period) {
+      age_count = 0;
+      age();
+    }
+    uint32_t b = slot_bucket[way];
+    uint64_t freq = buckets[b].freq;
+    if (freq >= sat) {                    // saturated, LFRU still refreshes the recency
+      if (policy == LFRU && buckets[b].last != way) {
+        list_remove(buckets[b].first, buckets[b].last, way);
+        list_append(buckets[b].first, buckets[b].last, way);
+      }
+      return;
+    }
+    uint32_t nb = buckets[b].next;
+    if (nb == NIL || buckets[nb].freq != freq + 1) {
+      if (buckets[b].first == buckets[b].last) {
+        buckets[b].freq = freq + 1;
+        if (policy == LFU)
+          lfu_update(way);
+        return;
+      }
+      nb = bucket_new(b, freq + 1);
+    }
+    bucket_remove(way);
+    list_append(buckets[nb].first, buckets[nb].last, way);
+    slot_bucket[way] = nb;
+    if (policy == LFU)
+      lfu_update(way);
+  }
+}
+
+uint64_t fa_cache_sim_t::victimize(uint64_t addr)
+{
+  uint64_t line = addr >> idx_shift;
+  uint32_t slot = lookup(line);
+  bool lfu = policy == LFU || policy == LFRU;
+
+  if (lfu && age_period && ++age_count == age_period) {
+    age_count = 0;
+    age();
+  }
+
+  bool rrip = policy == SRRIP || policy == BRRIP;
+  if (slot != NIL)                      // the block was invalidated, reuse its slot
+  {
+    if (lfu)
+      bucket_remove(slot);
+    else if (rrip)
+      list_remove(rrip_first[rrip_list[slot]], rrip_last[rrip_list[slot]], slot);
+    else if (uses_list())
+      list_remove(first, last, slot);
+  }
+  else
+  {
+    if (used < ways && !(policy == LRU && first_untouched))   // the cache is not full yet, use the next free slot
+      slot = used++;
+    else
+    {
+      if (policy == RANDOM)
+        slot = lfsr.next() % ways;
+      else if (policy == PLRU)
+      {
+        size_t node = 1;
+        while (node < ways)
+          node = 2*node + plru_tree[node];
+        slot = node - ways;
+      }
+      else if (policy == BIT_PLRU)
+      {
+        size_t w = 0;
+        while (!~mru_bits[w])           // skip words with every slot marked
+          w++;
+        slot = 64*w + __builtin_ctzll(~mru_bits[w]);
+      }
+      else if (policy == SRRIP || policy == BRRIP)
+      {
+        while (rrip_first[rrip_index(rrpv_max)] == NIL)   // age every slot until one is distant
+          rrip_base = (rrip_base + rrpv_max) % (rrpv_max + 1);
+        slot = rrip_first[rrip_index(rrpv_max)];
+      }
+      else if (policy == LFU)           // the lowest slot of the least used blocks
+        slot = uint32_t(lfu_tree[1]);
+      else if (lfu)                     // LFRU: the least recently used block of the least used bucket
+        slot = buckets[first_bucket].first;
+      else                              // FIFO: the oldest block, LRU: the least recently used block (or the
+        slot = first;                   // untouched first block, which is still the oldest)
+
+      if (lfu)
+        bucket_remove(slot);
+      else if (rrip)
+        list_remove(rrip_first[rrip_list[slot]], rrip_last[rrip_list[slot]], slot);
+      else if (uses_list())
+        list_remove(first, last, slot);
+      erase(set_tags(0)[slot]);
+    }
+    insert(line, slot);
+  }
+
+  if (lfu)                              // the new block has been used once
+  {
+    uint32_t b = first_bucket != NIL && buckets[first_bucket].freq == 1 ? first_bucket : bucket_new(NIL, 1);
+    list_append(buckets[b].first, buckets[b].last, slot);
+    slot_bucket[slot] = b;
+    if (policy == LFU)
+      lfu_update(slot);
+  }
+  else if (rrip)
+  {
+    uint64_t rrpv = rrpv_max - 1;
+    if (policy == BRRIP && ++bip_count % bip_period != 0)
+      rrpv = rrpv_max;
+    uint32_t l = rrip_index(rrpv);
+    list_append(rrip_first[l], rrip_last[l], slot);
+    rrip_list[slot] = l;
+  }
+  else if (uses_list())
+    list_append(first, last, slot);
+  else
+    plru_touch(slot);
+
+  if (policy == LRU && slot == 0)       // the first fill, or slot 0 refilled
+    first_untouched = !lru_started;
+  lru_started = true;
+  return replace(0, slot, addr);
+}
+
+void cache_memtracer_t::set_miss_handler(cache_sim_t* mh)
+{
+  // async 的 cache 在 consumer thread 存取它的 L2，另一個 cache 若在 spike 的 thread 存取同一個 L2
+  // 就沒有同步，所以共用 L2 的 I$ 與 D$ 必須都是 async 或都不是
+  static std::map<cache_sim_t*, bool> l2_async;
+  std::map<cache_sim_t*, bool>::iterator it = l2_async.find(mh);
+  if (it != l2_async.end() && it->second != (async != NULL)) {
+    std::cerr << "async must be given to both --ic and --dc when they share --l2" << std::endl;
+    exit(1);
+  }
+  l2_async[mh] = async != NULL;
+  cache->set_miss_handler(mh);
+}
+
+bool cache_memtracer_t::take_config_field(std::string& config, const char* key, std::string& value)
+{
+  std::string rest, prefix = std::string(key) + "=";
+  bool found = false;
+  for (size_t fp = 0; fp != std::string::npos; ) {
+    size_t ep = config.find(':', fp);
+    std::string field = config.substr(fp, ep == std::string::npos ? ep : ep - fp);
+    if (field == key || field.compare(0, prefix.size(), prefix) == 0) {
+      value = field == key ? "" : field.substr(prefix.size());
+      found = true;
+    }
+    else
+      rest += (fp == 0 ? "" : ":") + field;
+    fp = ep == std::string::npos ? ep : ep + 1;
+  }
+  config = rest;
+  return found;
+}
+
+// asynchronous simulation
+async_sim_t* async_sim_t::instance = NULL;
+
+async_sim_t* async_sim_t::open()
+{
+  if (!instance)
+    instance = new async_sim_t();
+  instance->refs++;
+  return instance;
+}
+
+void async_sim_t::close(async_sim_t* sim)
+{
+  if (--sim->refs == 0) {
+    instance = NULL;
+    delete sim;
+  }
+  else
+    sim->drain();
+}
+
+void async_sim_t::sync()
+{
+  if (instance)
+    instance->drain();
+}
+
+async_sim_t::async_sim_t()
+  : refs(0), staged(0), produced(0), consumed(0), ring(1 << 16)
+{
+  thread = std::thread(&async_sim_t::run, this);
+}
+
+async_sim_t::~async_sim_t()
+{
+  flush();
+  ring.close();
+  thread.join();
+}
+
+void async_sim_t::flush()
+{
+  ring.push_all(stage, staged);
+  produced += staged;
+  staged = 0;
+}
+
+void async_sim_t::drain()
+{
+  flush();
+  while (consumed.load(std::memory_order_acquire) != produced)
+    std::this_thread::yield();
+}
+
+void async_sim_t::run()
+{
+  std::vector<ref_t> items(4096);
+  std::vector<mem_ref> batch;
+  while (size_t n = ring.pop_wait(items.data(), items.size())) {
+    for (size_t i = 0; i < n; ) {
+      const ref_t& r = items[i];
+      if (r.op == SNAPSHOT) {
+        r.cache->snapshot(r.addr);
+        i++;
+        continue;
+      }
+      if (r.op & CLEAN_INVAL) {
+        r.cache->clean_invalidate(r.addr, r.bytes, r.op & CLEAN, r.op & INVAL);
+        i++;
+        continue;
+      }
+      batch.clear();            // a run of accesses to the same cache
+      for (; i < n && items[i].cache == r.cache && items[i].op <= WRITE; i++)
+        batch.push_back(mem_ref{items[i].addr, items[i].bytes, items[i].op == WRITE});
+      r.cache->access_batch(batch.data(), batch.size());
+    }
+    consumed.fetch_add(n, std::memory_order_release);
+  }
+}
+
+// trace writer
+static std::map<std::string, trace_writer_t*> trace_writers;
+
+trace_writer_t* trace_writer_t::open(const std::string& path)
+{
+  trace_writer_t*& writer = trace_writers[path];
+  if (!writer)
+    writer = new trace_writer_t(path);
+  writer->refs++;
+  return writer;
+}
+
+void trace_writer_t::close(trace_writer_t* writer)
+{
+  if (--writer->refs == 0) {
+    trace_writers.erase(writer->path);
+    delete writer;
+  }
+}
+
+trace_writer_t::trace_writer_t(const std::string& _path)
+  : path(_path), refs(0), cur(0), fill(0), pending(NULL), pending_len(0), done(false)
+{
+  file = fopen(path.c_str(), "wb");
+  if (!file) {
+    std::cerr << "cannot open trace file " << path << std::endl;
+    exit(1);
+  }
+  fwrite("CSTRACE1", 1, 8, file);
+  buf[0] = new uint8_t[BUF_BYTES];
+  buf[1] = new uint8_t[BUF_BYTES];
+  memset(last_addr, 0, sizeof(last_addr));
+  memset(last_bytes, 0, sizeof(last_bytes));
+  thread = std::thread(&trace_writer_t::run, this);
+}
+
+trace_writer_t::~trace_writer_t()
+{
+  flip();
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this] { return pending == NULL; });
+    done = true;
+  }
+  cond.notify_all();
+  thread.join();
+  fclose(file);
+  delete [] buf[0];
+  delete [] buf[1];
+}
+
+void trace_writer_t::flip()
+{
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this] { return pending == NULL; });   // the other buffer must be written out first
+    pending = buf[cur];
+    pending_len = fill;
+  }
+  cond.notify_all();
+  cur ^= 1;
+  fill = 0;
+}
+
+void trace_writer_t::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  for (;;) {
+    cond.wait(guard, [this] { return pending != NULL || done; });
+    if (!pending)
+      return;
+    const uint8_t* data = pending;
+    size_t len = pending_len;
+    guard.unlock();
+    if (fwrite(data, 1, len, file) != len)
+      std::cerr << "error writing trace file " << path << std::endl;
+    guard.lock();
+    pending = NULL;
+    cond.notify_all();
+  }
+}
+
+// stats sink
+static std::map<std::string, stats_sink_t*> stats_sinks;
+
+void stats_record_t::add(const char* key, double value)
+{
+  char text[32];
+  snprintf(text, sizeof(text), "%.6f", value);
+  fields.push_back(field_t{key, text, false});
+}
+
+stats_sink_t* stats_sink_t::open(const std::string& path)
+{
+  stats_sink_t*& sink = stats_sinks[path];
+  if (!sink)
+    sink = new stats_sink_t(path);
+  sink->refs++;
+  return sink;
+}
+
+void stats_sink_t::close(stats_sink_t* sink)
+{
+  if (--sink->refs == 0) {
+    stats_sinks.erase(sink->path);
+    delete sink;
+  }
+}
+
+stats_sink_t::stats_sink_t(const std::string& _path)
+  : path(_path), refs(0)
+{
+  file = fopen(path.c_str(), "w");   // 先開檔，路徑錯誤時在模擬開始前就結束
+  if (!file) {
+    std::cerr << "cannot open stats file " << path << std::endl;
+    exit(1);
+  }
+}
+
+stats_sink_t::~stats_sink_t()
+{
+  bool csv_file = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+  std::string out = csv_file ? csv() : json();
+  fwrite(out.data(), 1, out.size(), file);   // 整個檔案一次寫出
+  fclose(file);
+}
+
+static std::string quote(const std::string& value, char escape)
+{
+  std::string out = "\"";
+  for (size_t i = 0; i < value.size(); i++) {
+    if (value[i] == '"' || value[i] == escape)
+      out += escape;
+    out += value[i];
+  }
+  return out + '"';
+}
+
+std::string stats_sink_t::json() const
+{
+  std::string out = "[";
+  for (size_t r = 0; r < records.size(); r++) {
+    out += r ? ",\n  {" : "\n  {";
+    const std::vector<stats_record_t::field_t>& fields = records[r].fields;
+    for (size_t f = 0; f < fields.size(); f++) {
+      out += (f ? ", " : "") + quote(fields[f].key, '\\') + ": ";
+      out += fields[f].text ? quote(fields[f].value, '\\') : fields[f].value;
+    }
+    out += "}";
+  }
+  return out + "\n]\n";
+}
+
+std::string stats_sink_t::csv() const
+{
+  // 欄位為所有 records 欄位的聯集 (e.g. 只有 DRRIP 的 cache 有 drrip_*)，依第一次出現的順序
+  std::vector<std::string> keys;
+  for (size_t r = 0; r < records.size(); r++)
+    for (size_t f = 0; f < records[r].fields.size(); f++)
+      if (std::find(keys.begin(), keys.end(), records[r].fields[f].key) == keys.end())
+        keys.push_back(records[r].fields[f].key);
+
+  std::string out;
+  for (size_t k = 0; k < keys.size(); k++)
+    out += (k ? "," : "") + keys[k];
+  out += "\n";
+  for (size_t r = 0; r < records.size(); r++) {
+    for (size_t k = 0; k < keys.size(); k++) {
+      if (k)
+        out += ",";
+      for (size_t f = 0; f < records[r].fields.size(); f++)
+        if (records[r].fields[f].key == keys[k])
+          out += records[r].fields[f].text ? quote(records[r].fields[f].value, '"') : records[r].fields[f].value;
+    }
+    out += "\n";
+  }
+  return out;
+}
+
+// interval statistics
+static std::vector<std::string> series_paths;   // 兩個 cache 不能寫同一個檔案
+
+series_writer_t::series_writer_t(const std::string& _path, bool instructions)
+  : path(_path), held(false)
+{
+  if (std::find(series_paths.begin(), series_paths.end(), path) != series_paths.end()) {
+    std::cerr << "series file " << path << " is given to more than one cache" << std::endl;
+    exit(1);
+  }
+  series_paths.push_back(path);
+  file = fopen(path.c_str(), "wb");
+  if (!file) {
+    std::cerr << "cannot open series file " << path << std::endl;
+    exit(1);
+  }
+  csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+  buf.reserve(BUF_BYTES + 256);
+  if (csv)
+    buf = std::string(instructions ? "instructions" : "accesses")
+        + ",bytes_read,bytes_written,read_accesses,write_accesses,read_misses,write_misses,writebacks,miss_rate\n";
+  else {
+    uint64_t unit = instructions;
+    buf.append("CSSERIE1", 8);
+    buf.append((const char*)&unit, sizeof(unit));
+  }
+}
+
+series_writer_t::~series_writer_t()
+{
+  if (held)
+    write(last);
+  flush();
+  fclose(file);
+  series_paths.erase(std::find(series_paths.begin(), series_paths.end(), path));
+}
+
+void series_writer_t::put(const uint64_t* row)
+{
+  if (held && row[0] == last[0]) {
+    for (size_t i = 1; i < FIELDS; i++)
+      last[i] += row[i];
+    return;
+  }
+  if (held)
+    write(last);
+  memcpy(last, row, sizeof(last));
+  held = true;
+}
+
+void series_writer_t::write(const uint64_t* row)
+{
+  if (csv) {
+    char line[256];
+    int len = 0;
+    for (size_t i = 0; i < FIELDS; i++)
+      len += snprintf(line + len, sizeof(line) - len, "%llu,", (unsigned long long)row[i]);
+    uint64_t accesses = row[3] + row[4], misses = row[5] + row[6];
+    len += snprintf(line + len, sizeof(line) - len, "%.6f\n", accesses ? 100.0 * misses / accesses : 0.0);
+    buf.append(line, len);
+  }
+  else
+    buf.append((const char*)row, FIELDS * sizeof(uint64_t));
+  if (buf.size() >= BUF_BYTES)
+    flush();
+}
+
+void series_writer_t::flush()
+{
+  fwrite(buf.data(), 1, buf.size(), file);
+  buf.clear();
+}
+
+// prefetchers
+prefetcher_t* prefetcher_t::construct(const std::string& kind, size_t line_shift, uint64_t degree, uint64_t distance, uint64_t entries)
+{
+  if (kind == "next")
+    return new next_line_prefetcher_t(degree, distance);
+  if (kind == "stride")
+    return new stride_prefetcher_t(line_shift, degree, distance, entries);
+  if (kind == "stream")
+    return new stream_prefetcher_t(degree, distance, entries);
+  return NULL;
+}
+
+void next_line_prefetcher_t::train(uint64_t line, bool trigger, std::vector<uint64_t>& out)
+{
+  if (trigger)
+    issue(line, 1, out);
+}
+
+stride_prefetcher_t::stride_prefetcher_t(size_t line_shift, uint64_t degree, uint64_t distance, uint64_t entries)
+  : prefetcher_t(degree, distance), region_shift(line_shift < 12 ? 12 - line_shift : 0), table(entries)
+{
+  for (size_t i = 0; i < table.size(); i++)
+    table[i].valid = false;
+}
+
+void stride_prefetcher_t::train(uint64_t line, bool UNUSED trigger, std::vector<uint64_t>& out)
+{
+  uint64_t region = line >> region_shift;
+  entry_t& e = table[region % table.size()];
+  if (!e.valid || e.region != region) {
+    e.region = region;
+    e.last = line;
+    e.stride = 0;
+    e.confidence = 0;
+    e.valid = true;
+    return;
+  }
+  int64_t stride = int64_t(line - e.last);
+  if (stride == 0)    // 同一個 line 中的 accesses
+    return;
+  if (stride == e.stride)
+    e.confidence = std::min(e.confidence + 1, 3u);
+  else {
+    e.stride = stride;
+    e.confidence = 0;
+  }
+  e.last = line;
+  if (e.confidence >= 1)
+    issue(line, e.stride, out);
+}
+
+stream_prefetcher_t::stream_prefetcher_t(uint64_t degree, uint64_t distance, uint64_t entries)
+  : prefetcher_t(degree, distance), streams(entries), now(0)
+{
+  for (size_t i = 0; i < streams.size(); i++)
+    streams[i].used = 0;
+}
+
+void stream_prefetcher_t::train(uint64_t line, bool trigger, std::vector<uint64_t>& out)
+{
+  if (!trigger)   // 只看 misses 與 prefetched lines 的第一次使用
+    return;
+  now++;
+  stream_t* lru = &streams[0];
+  for (size_t i = 0; i < streams.size(); i++) {
+    stream_t& s = streams[i];
+    if (s.used == 0) {
+      lru = &s;
+      continue;
+    }
+    int64_t delta = int64_t(line - s.last);
+    bool ahead = s.direction ? delta * s.direction > 0 && delta * s.direction <= WINDOW
+                             : delta != 0 && delta >= -WINDOW && delta <= WINDOW;
+    if (ahead) {
+      if (!s.direction)
+        s.direction = delta > 0 ? 1 : -1;
+      s.confidence++;
+      s.last = line;
+      s.used = now;
+      if (s.confidence >= 2)
+        issue(line, s.direction, out);
+      return;
+    }
+    if (s.used < lru->used)
+      lru = &s;
+  }
+  lru->last = line;   // 新的 stream
+  lru->direction = 0;
+  lru->confidence = 0;
+  lru->used = now;
+}
+
+side_buffer_t::slot_t* side_buffer_t::find(uint64_t line)
+{
+  for (size_t i = 0; i < slots.size(); i++)
+    if (slots[i].used && slots[i].line == line)
+      return &slots[i];
+  return NULL;
+}
+
+bool side_buffer_t::touch(uint64_t line)
+{
+  slot_t* s = find(line);
+  if (s)
+    s->used = ++now;
+  return s != NULL;
+}
+
+bool side_buffer_t::take(uint64_t line, bool& dirty)
+{
+  slot_t* s = find(line);
+  if (!s)
+    return false;
+  dirty = s->dirty;
+  s->used = 0;
+  return true;
+}
+
+bool side_buffer_t::put(uint64_t line, bool dirty, uint64_t& out, bool& out_dirty)
+{
+  slot_t* s = &slots[0];
+  for (size_t i = 1; i < slots.size() && s->used; i++)   // 空的 slot，或是 LRU 的 entry
+    if (slots[i].used < s->used)
+      s = &slots[i];
+  bool displaced = s->used != 0;
+  out = s->line;
+  out_dirty = s->dirty;
+  s->line = line;
+  s->dirty = dirty;
+  s->used = ++now;
+  return displaced;
+}
+
+bool side_buffer_t::clean(uint64_t line)
+{
+  slot_t* s = find(line);
+  bool dirty = s && s->dirty;
+  if (s)
+    s->dirty = false;
+  return dirty;
+}
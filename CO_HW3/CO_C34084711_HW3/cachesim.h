@@ -0,0 +1,946 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_CACHE_SIM_H
+#define _RISCV_CACHE_SIM_H
+
+#include "memtracer.h"
+#include "common.h"
+#include <cstring>
+#include <string>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+class lfsr_t  // used to generate pseudo-random numbers for cache line replacement
+{
+ public:
+  lfsr_t() : reg(1) {}  
+  lfsr_t(const lfsr_t& lfsr) : reg(lfsr.reg) {}   
+  uint32_t next() { return reg = (reg>>1)^(-(reg&1) & 0xd0000001); }
+ private:
+  uint32_t reg;
+};
+
+struct mem_ref   // one memory reference, the unit of cache_sim_t::access_batch
+{
+  uint64_t addr;
+  uint32_t bytes;
+  bool store;
+};
+
+// One cache's statistics for stats_sink_t, the fields in the order they are written.
+// Values are kept as text, numbers already formatted.
+class stats_record_t
+{
+ public:
+  void add(const char* key, const std::string& value) { fields.push_back(field_t{key, value, true}); }
+  void add(const char* key, uint64_t value) { fields.push_back(field_t{key, std::to_string(value), false}); }
+  void add(const char* key, double value);
+
+  struct field_t
+  {
+    std::string key;
+    std::string value;
+    bool text;      // quoted in JSON
+  };
+  std::vector<field_t> fields;
+};
+
+// Collects the records of every cache whose config has a stats=path field and writes them to
+// 'path' once, when the last of these caches is destroyed: a JSON array with one object per cache,
+// or CSV with one row per cache when 'path' ends in .csv.
+class stats_sink_t
+{
+ public:
+  static stats_sink_t* open(const std::string& path);   // caches given the same path share one file
+  static void close(stats_sink_t* sink);
+  void add(const stats_record_t& record) { records.push_back(record); }
+
+ private:
+  stats_sink_t(const std::string& path);
+  ~stats_sink_t();
+  std::string json() const;
+  std::string csv() const;
+
+  std::string path;
+  FILE* file;
+  int refs;
+  std::vector<stats_record_t> records;
+};
+
+// Interval statistics of one cache, written by cache_sim_t when its config has series=path and
+// interval=N (every N accesses to the cache) or interval=Ninst (every N instructions, I$/D$ only).
+// Each row holds the end of the interval, in accesses or instructions, and the change of every
+// counter during it: bytes_read, bytes_written, read_accesses, write_accesses, read_misses,
+// write_misses, writebacks. The last row covers what is left at exit.
+// CSV when 'path' ends in .csv (with a miss_rate column), otherwise binary: the 8-byte magic
+// "CSSERIE1", a uint64 unit (0 accesses, 1 instructions), then 8 uint64 per row, little-endian.
+// Rows are collected in memory and written in large blocks.
+class series_writer_t
+{
+ public:
+  static const size_t FIELDS = 8;
+  series_writer_t(const std::string& path, bool instructions);
+  ~series_writer_t();
+  // 一個 row 與前一個 row 的位置相同時 (instruction 模式下最後一個 snapshot 之後還有 data references)
+  // 併入前一個 row，所以最後一個 row 要等到下一個 row 或 close 才寫出
+  void put(const uint64_t* row);
+
+ private:
+  static const size_t BUF_BYTES = 1 << 20;
+  void write(const uint64_t* row);
+  void flush();
+
+  std::string path;
+  FILE* file;
+  bool csv;
+  std::string buf;
+  uint64_t last[FIELDS];    // 還沒寫出的 row
+  bool held;
+};
+
+// Hardware prefetcher attached to a cache_sim_t with prefetch=next|stride|stream. It sees every
+// demand access as a block address (line) and proposes blocks to prefetch, which the cache fills
+// through victimize and its miss_handler like a demand miss. Lines are block addresses, signed
+// strides wrap around like the hardware's address arithmetic.
+class prefetcher_t
+{
+ public:
+  virtual ~prefetcher_t() {}
+  // 'trigger' is true on a demand miss or on the first use of a prefetched line, the blocks to
+  // prefetch are appended to 'out'
+  virtual void train(uint64_t line, bool trigger, std::vector<uint64_t>& out) = 0;
+
+  // NULL for an unknown kind
+  static prefetcher_t* construct(const std::string& kind, size_t line_shift, uint64_t degree, uint64_t distance, uint64_t entries);
+
+ protected:
+  prefetcher_t(uint64_t _degree, uint64_t _distance) : degree(_degree), distance(_distance) {}
+  void issue(uint64_t line, int64_t step, std::vector<uint64_t>& out) const   // 'degree' lines from 'distance' steps ahead
+  {
+    for (uint64_t k = 0; k < degree; k++)
+      out.push_back(line + step * int64_t(distance + k));
+  }
+
+  uint64_t degree;
+  uint64_t distance;
+};
+
+// tagged next-line: a miss or the first use of a prefetched line prefetches the following lines
+class next_line_prefetcher_t : public prefetcher_t
+{
+ public:
+  next_line_prefetcher_t(uint64_t degree, uint64_t distance) : prefetcher_t(degree, distance) {}
+  void train(uint64_t line, bool trigger, std::vector<uint64_t>& out);
+};
+
+// Constant strides per access stream. Without the PC the streams are told apart by 4 KiB region:
+// a direct-mapped table of 'entries' regions keeps the last line and stride of each, a stride seen
+// twice in a row prefetches along it.
+class stride_prefetcher_t : public prefetcher_t
+{
+ public:
+  stride_prefetcher_t(size_t line_shift, uint64_t degree, uint64_t distance, uint64_t entries);
+  void train(uint64_t line, bool trigger, std::vector<uint64_t>& out);
+ private:
+  struct entry_t
+  {
+    uint64_t region;
+    uint64_t last;
+    int64_t stride;
+    uint32_t confidence;
+    bool valid;
+  };
+  size_t region_shift;   // log2 of the lines per region
+  std::vector<entry_t> table;
+};
+
+// Stream buffers in the style of Jouppi / IBM POWER: up to 'entries' streams follow sequential
+// misses in either direction, a stream that advanced twice prefetches ahead of it. Streams are
+// replaced in LRU order.
+class stream_prefetcher_t : public prefetcher_t
+{
+ public:
+  stream_prefetcher_t(uint64_t degree, uint64_t distance, uint64_t entries);
+  void train(uint64_t line, bool trigger, std::vector<uint64_t>& out);
+ private:
+  static const int64_t WINDOW = 16;   // a miss this many lines ahead of a stream still belongs to it
+  struct stream_t
+  {
+    uint64_t last;
+    int64_t direction;    // 0 until the second miss
+    uint32_t confidence;
+    uint64_t used;        // LRU stamp, 0 for an unused stream
+  };
+  std::vector<stream_t> streams;
+  uint64_t now;
+};
+
+// Small fully associative LRU buffer between a cache_sim_t and its miss_handler (Jouppi 1990):
+// victim=N holds the blocks the cache evicts and swaps them back in on a hit, misscache=N holds a
+// copy of every block the cache fetched. Entries are block addresses (lines); a few entries are
+// searched linearly.
+class side_buffer_t
+{
+ public:
+  side_buffer_t(size_t entries) : slots(entries), now(0) {}
+
+  bool touch(uint64_t line);                     // hit: refresh its recency
+  bool take(uint64_t line, bool& dirty);         // hit: remove it, 'dirty' tells whether it was modified
+  // insert 'line', which is not in the buffer, true if that displaced a valid entry, which is
+  // returned in 'out'/'out_dirty'
+  bool put(uint64_t line, bool dirty, uint64_t& out, bool& out_dirty);
+  bool clean(uint64_t line);                     // clear the dirty bit, true if it was set
+
+ private:
+  struct slot_t
+  {
+    uint64_t line;
+    bool dirty;
+    uint64_t used;    // LRU stamp, 0 for an empty slot
+  };
+  slot_t* find(uint64_t line);
+  std::vector<slot_t> slots;
+  uint64_t now;
+};
+
+class cache_sim_t   // a base class representing a generic cache, with methods for accessing cache lines and statistics tracking
+{
+ public:
+  cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name, size_t meta_bytes = 0);
+  cache_sim_t(const cache_sim_t& rhs);
+  virtual ~cache_sim_t();
+
+  void access(uint64_t addr, size_t bytes, bool store);
+  void access_batch(const mem_ref* refs, size_t n);   // 依序處理 n 個 references，效果與逐一呼叫 access 相同
+  void clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool inval);
+  void print_stats();   // 只印一次，與 emit_stats 相同由最外層的 destructor 呼叫，policy 的統計才印得出來
+  void set_miss_handler(cache_sim_t* mh);   // 'mh' 也記下這個 cache 是它的上一層
+  void set_log(bool _log) { log = _log; }
+  void take_stats(cache_sim_t& rhs);   // 把 rhs 的統計加到這個 cache 並清除 rhs 的統計
+  // 解構時把統計交給 sink，'meta' 為放在每筆 record 最前面的欄位 (cache、config、policy、bench)
+  void set_stats_sink(stats_sink_t* sink, const stats_record_t& meta) { stats_sink = sink; stats_meta = meta; }
+  void emit_stats();   // 把統計加入 sink 並關閉它，由最外層的 destructor 呼叫，policy 的欄位才拿得到
+
+  // interval statistics：每 'period' 個 accesses 自動 snapshot，instructions 模式由呼叫端數 instructions
+  void set_series(series_writer_t* writer, uint64_t period, bool instructions);
+  bool has_series() const { return series != NULL; }
+  uint64_t instruction_interval() const { return series && series_insts ? series_period : 0; }
+  void snapshot(uint64_t position);         // 寫出上次 snapshot 之後各統計的變化，'position' 為目前的 accesses/instructions 數
+  void close_series(uint64_t position);     // 寫出剩下的部分並關閉檔案
+
+  // set sampling：只模擬約 1/period 的 sets (依 set index 的 hash 選出)，也只有它們有 set record，其他 sets 的
+  // references 只計數，misses 與 writebacks 依比例推估，並以各個 sampled set 的 miss rate 變異估計 95% 信賴區間
+  void set_sampling(uint64_t period);
+
+  // prefetch 填入的 line 在第一次 demand access 時算 useful，距離發出不到 'latency' 個 accesses 的算 late；
+  // 被 prefetch 擠出去、之後又被 demand miss 的 line 算 polluting (只記得大約最近 sets*ways 個被擠出去的 lines，
+  // 更早的即使沒有 prefetch 多半也已經被替換了)
+  void set_prefetcher(prefetcher_t* p, uint64_t latency);
+
+  // 這個 cache 與上一層 (miss_handler 為這個 cache 的 caches) 的關係：
+  // NINE 不做任何處理；INCLUSIVE 替換掉的 block 也從所有上層清除 (back-invalidation)，上層 dirty 的資料由這層寫回；
+  // EXCLUSIVE 只存放上層替換掉的 blocks (clean 或 dirty)，上層 miss 命中時 block 移到上層，miss 時不配置
+  enum inclusion_t { NINE, INCLUSIVE, EXCLUSIVE };
+  void set_inclusion(inclusion_t i) { inclusion = i; }
+  bool has_prefetcher() const { return prefetcher != NULL; }
+
+  // victim=N 或 misscache=N：miss 先查 side buffer，命中就不必向下一層 fetch
+  enum side_t { NO_SIDE, VICTIM_CACHE, MISS_CACHE };
+  void set_side_buffer(side_t kind, size_t entries);
+  bool has_side_buffer() const { return side != NULL; }
+
+  // classify：把每個 miss 分成 compulsory (第一次 access 這個 line)、capacity (同容量的 fully associative LRU
+  // 也會 miss) 或 conflict (只有這個 cache 會 miss)
+  void set_classify();
+  bool classifies() const { return shadow != NULL; }
+
+  size_t num_sets() const { return sets; }
+  size_t set_index(uint64_t addr) const { return (addr >> idx_shift) & (sets-1); }
+  // 每個 set 的狀態只受到自己的 references 影響，可以把 sets 分給多個 thread 各自模擬
+  virtual bool sets_independent() const { return false; }   // random 的 lfsr 由所有 sets 共用
+  // 這個 cache 的第一個 block 由另一個 copy 填入 (cachesim_replay --threads)，見 lru_cache_sim_t
+  virtual void skip_first_fill() {}
+
+  static cache_sim_t* construct(const char* config, const char* name);
+
+ protected:
+  static const uint64_t VALID = 1ULL << 63;   // 100000...0000, 64 bits
+  static const uint64_t DIRTY = 1ULL << 62;   // 010000...0000, 64 bits
+
+  virtual uint64_t* check_tag(uint64_t addr, size_t& way);   // 回傳 hit 的 tag slot，並由 'way' 帶回 hit 的 way index
+  virtual uint64_t victimize(uint64_t addr);   // 回傳被替換的 block，並帶有 VALID/DIRTY 位元
+  uint64_t replace(size_t idx, size_t way, uint64_t addr);   // 把 addr 填入指定的 way，回傳原本的 block
+  virtual void on_hit(size_t UNUSED idx, size_t UNUSED way) {}   // called on every cache hit so the replacement policy can update its state
+  virtual void policy_stats(stats_record_t&) {}   // replacement policy 自己的統計欄位
+  virtual void print_policy_stats() {}            // 同上，印在 print_stats 的最後
+
+  lfsr_t lfsr;    // 採取 lfsr policy
+  cache_sim_t* miss_handler;
+  std::vector<mem_ref> miss_refs;   // access_batch 累積要送往下一層的 writebacks 與 fills
+
+  size_t sets;
+  size_t ways;
+  size_t linesz;
+  size_t meta_bytes;  // 每個 set 給 replacement policy 使用的 metadata bytes 數
+  size_t idx_shift;
+
+  size_t mask_words;  // valid/dirty bitmask 各需要幾個 64-bit words
+  size_t tag_slots;   // 每個 set 的 tag 個數，補齊到 8 的倍數
+  size_t set_bytes;   // 一個 set record 的大小 (bitmasks + tags + metadata)，為 64 bytes 的倍數
+  uint8_t* set_mem;   // set records 配置到的記憶體
+  uint8_t* set_base;  // 對齊 64 bytes 後的第一個 set record
+  size_t set_records; // set records 的個數，sampling 時只有 sampled sets 有 record，依 sample_slot 排列
+
+  uint64_t (*match_tags)(const uint64_t* tags, size_t n, uint64_t tag);   // 一次比對整個 set 的 tag (SIMD 或 scalar)
+
+  size_t record(size_t idx) const { return likely(sample_period == 0) ? idx : size_t(sample_slot[idx]); }
+  bool unsampled(size_t idx) const { return unlikely(sample_period != 0) && sample_slot[idx] < 0; }   // 沒有 set record
+  uint64_t* set_valid(size_t idx) { return (uint64_t*)(set_base + record(idx)*set_bytes); }   // 每個 way 一個 valid 位元
+  uint64_t* set_dirty(size_t idx) { return set_valid(idx) + mask_words; }             // 每個 way 一個 dirty 位元
+  uint64_t* set_tags(size_t idx) { return set_valid(idx) + 2*mask_words; }            // 儲存 block 的 tag 值 (block address)
+  uint8_t* set_meta(size_t idx) { return (uint8_t*)(set_tags(idx) + tag_slots); }     // 緊接在 tags 後面的 policy metadata
+
+  static bool test_bit(const uint64_t* mask, size_t way) { return (mask[way >> 6] >> (way & 63)) & 1; }
+  static void set_bit(uint64_t* mask, size_t way) { mask[way >> 6] |= 1ULL << (way & 63); }
+  static void clear_bit(uint64_t* mask, size_t way) { mask[way >> 6] &= ~(1ULL << (way & 63)); }
+  
+  uint64_t read_accesses;
+  uint64_t read_misses;
+  uint64_t bytes_read;
+  uint64_t write_accesses;
+  uint64_t write_misses;
+  uint64_t bytes_written;
+  uint64_t writebacks;
+
+  std::string name;
+  bool log;
+  bool printed;                // print_stats 已經印過
+  stats_sink_t* stats_sink;    // 沒有 stats= 時為 NULL
+  stats_record_t stats_meta;
+  series_writer_t* series;     // 沒有 series= 時為 NULL
+  uint64_t series_period;
+  uint64_t series_left;        // access 模式下距離下一個 snapshot 的 accesses 數，0 表示不計數
+  bool series_insts;
+  uint64_t series_last[series_writer_t::FIELDS - 1];   // 上次 snapshot 時的統計
+
+  uint64_t sample_period;                 // 0 為模擬所有 sets
+  std::vector<int32_t> sample_slot;       // 每個 set 在 sample_accesses/sample_misses 的位置，-1 為沒有 sampled
+  std::vector<uint64_t> sample_accesses;  // 每個 sampled set 的 accesses 與 misses，用來估計信賴區間
+  std::vector<uint64_t> sample_misses;
+  uint64_t skipped_reads;                 // 沒有 sampled 的 sets 的 references
+  uint64_t skipped_writes;
+  uint64_t skipped_bytes_read;
+  uint64_t skipped_bytes_written;
+
+  bool sample(size_t idx, size_t bytes, bool store)   // 是否模擬這個 reference，沒有 sampled 的只計數
+  {
+    int32_t slot = sample_slot[idx];
+    if (slot < 0) {
+      store ? skipped_writes++ : skipped_reads++;
+      (store ? skipped_bytes_written : skipped_bytes_read) += bytes;
+      return false;
+    }
+    sample_accesses[slot]++;
+    return true;
+  }
+  void totals(uint64_t* out) const;   // series_writer_t 順序的 7 個統計，sampling 時為推估的全部 sets 的值
+  uint64_t scaled(uint64_t count) const;   // sampled sets 的 count 推估到全部 sets
+
+  prefetcher_t* prefetcher;                       // 沒有 prefetch= 時為 NULL
+  uint64_t prefetch_latency;
+  std::unordered_map<uint64_t, uint64_t> prefetched;   // 還沒被使用的 prefetched line -> 發出時的 accesses 數
+  // 被 prefetch 擠出去、還沒再被 access 的 lines (存 line + 1，0 為空)，固定 sets*ways 個 entries，
+  // 以 line % (sets*ways) 為 index，同一個 set 的 lines 各自分到 ways 個 entries，新的覆蓋舊的
+  std::vector<uint64_t> prefetch_evicted;
+  std::vector<uint64_t> prefetch_lines;
+  uint64_t prefetches_issued;
+  uint64_t prefetches_useful;
+  uint64_t prefetches_late;
+  uint64_t prefetches_polluting;
+
+  void prefetch_train(uint64_t addr, bool miss);   // demand access 之後更新統計並發出 prefetches
+  void prefetch(uint64_t addr);
+
+  inclusion_t inclusion;
+  std::vector<cache_sim_t*> uppers;   // miss_handler 為這個 cache 的 caches
+  cache_sim_t* owned_lower;           // construct() 依 config 中的 ',' 建立的下一層，隨這個 cache 一起刪除
+  uint64_t back_invalidations;        // INCLUSIVE: 從上層清除的 lines
+  uint64_t victims_inserted;          // EXCLUSIVE: 放入的上層 victims
+
+  void evict(uint64_t victim);        // 處理 victimize 換出的 block：back-invalidation、寫回或交給 exclusive 的下一層
+  bool back_invalidate(uint64_t addr, size_t bytes, uint64_t& lines);   // 從這層與更上層清除，回傳是否有 dirty 的 line
+  void exclusive_access(uint64_t addr, size_t bytes, bool store);
+  void insert_victim(uint64_t addr, bool dirty);
+  side_t side_kind;
+  side_buffer_t* side;                // 沒有 victim=/misscache= 時為 NULL
+  uint64_t side_hits;                 // 在 side buffer 命中的 misses
+  uint64_t writebacks_saved;          // 留在 victim cache 中、還沒 (或不必) 寫回下一層的 dirty blocks
+
+  bool side_lookup(uint64_t addr, bool& dirty);   // miss 時查 side buffer，命中回傳 true
+
+  cache_sim_t* shadow;                      // classify: 同容量的 fully associative LRU (fa_cache_sim_t)，沒有時為 NULL
+  std::unordered_set<uint64_t> touched;     // classify: miss 過的 lines
+  uint64_t compulsory_misses;
+  uint64_t capacity_misses;
+  uint64_t conflict_misses;
+  void classify(uint64_t addr, bool miss);   // 每個 access 都要更新 shadow，miss 時分類
+  double miss_rate_ci95() const;      // sampling 時 miss rate (%) 95% 信賴區間的半寬，sampled sets 不到 2 個時為 -1
+
+  void init();
+};
+
+class fa_cache_sim_t : public cache_sim_t       // a derived class implementing a fully associative cache, with methods for checking tags and victimizing lines
+{
+ public:
+  enum policy_t { RANDOM, FIFO, LRU, LFU, LFRU, PLRU, BIT_PLRU, SRRIP, BRRIP };
+  fa_cache_sim_t(size_t ways, size_t linesz, const char* name, policy_t policy = RANDOM,
+                 uint64_t sat = UINT32_MAX, uint64_t age_period = 0,
+                 size_t rrpv_bits = 2, uint64_t bip_period = 32);
+  uint64_t* check_tag(uint64_t addr, size_t& way);
+  uint64_t victimize(uint64_t addr);
+  void skip_first_fill() { lru_started = true; }
+ protected:
+  void on_hit(size_t idx, size_t way);
+ private:
+  static const uint32_t NIL = UINT32_MAX;
+
+  // open addressing hash table (linear probing) from block address to slot, so lookup is O(1)
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> vals;   // NIL marks an empty entry
+  size_t hash_mask;
+  size_t hash_pos(uint64_t line) const { return (line * 0x9e3779b97f4a7c15ULL) >> 32 & hash_mask; }
+  uint32_t lookup(uint64_t line) const;
+  void insert(uint64_t line, uint32_t slot);
+  void erase(uint64_t line);
+
+  // intrusive lists of slots, from oldest (LRU) to newest (MRU)
+  std::vector<uint32_t> prev, next;
+  void list_append(uint32_t& first, uint32_t& last, uint32_t slot);
+  void list_remove(uint32_t& first, uint32_t& last, uint32_t slot);
+
+  struct bucket_t     // LFU/LFRU: all blocks with the same use count
+  {
+    uint64_t freq;
+    uint32_t prev, next;    // neighbouring buckets, ordered by 'freq'
+    uint32_t first, last;   // blocks of this bucket
+  };
+  std::vector<bucket_t> buckets;
+  std::vector<uint32_t> slot_bucket;
+  uint32_t first_bucket, free_bucket;
+  uint32_t bucket_new(uint32_t prev, uint64_t freq);
+  void bucket_remove(uint32_t slot);
+  void age();
+
+  // LFU: tournament tree over the slots of (use count << 32 | slot), the root is the block with the
+  // smallest count and among those the lowest slot, the same tie-break as the set-associative LFU
+  std::vector<uint64_t> lfu_tree;
+  size_t lfu_leaves;
+  void lfu_update(uint32_t slot);
+
+  std::vector<uint8_t> plru_tree;     // PLRU: node i has children 2i and 2i+1, slot w is leaf w+ways
+  std::vector<uint64_t> mru_bits;     // BIT_PLRU: one bit per slot
+  size_t mru_count;                   // BIT_PLRU: number of bits set
+  void plru_touch(uint32_t slot);
+  bool uses_list() const { return policy == FIFO || policy == LRU; }
+
+  // SRRIP/BRRIP: one list per RRPV, list (rrpv + rrip_base) % (rrpv_max + 1) holds the slots
+  // with that RRPV, so aging every slot only moves 'rrip_base'
+  std::vector<uint32_t> rrip_first, rrip_last;
+  std::vector<uint8_t> rrip_list;     // list of each slot
+  uint64_t rrpv_max;
+  uint64_t rrip_base;
+  uint64_t bip_period;
+  uint64_t bip_count;
+  uint32_t rrip_index(uint64_t rrpv) const { return (rrpv + rrip_base) % (rrpv_max + 1); }
+  void rrip_move(uint32_t slot, uint64_t rrpv);
+
+  policy_t policy;
+  size_t used;              // slots filled so far
+  uint32_t first, last;     // FIFO/LRU list
+  bool lru_started;         // LRU: 與 lru_cache_sim_t 相同，slot 0 的第一個 block 在被使用之前
+  bool first_untouched;     // 和空的 slots 一樣先被替換
+  uint64_t sat;
+  uint64_t age_period;
+  uint64_t age_count;
+};
+
+// FIFO, evict the block which entered the cache earliest
+class fifo_cache_sim_t : public cache_sim_t
+{
+ public:
+  fifo_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name);
+  bool sets_independent() const { return true; }   // only the order of 'time' within a set matters
+  void skip_first_fill() { time = 1; }
+ protected:
+  uint64_t victimize(uint64_t addr);
+
+  uint64_t time;          // 'time' is used to decide the first time of block to enter the cache
+};
+
+// LRU, evict the block which is least recently used, both victim selection and hit update are O(1)
+class lru_cache_sim_t : public cache_sim_t
+{
+ public:
+  lru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name);
+  bool sets_independent() const { return true; }
+  void skip_first_fill() { started = true; }
+ protected:
+  uint64_t victimize(uint64_t addr);
+  void on_hit(size_t idx, size_t way);
+  void touch(size_t idx, size_t way);   // move 'way' to the MRU position of its set
+
+  // 與 baseline 相同：第一個填入的 block 的 access time 為 0，和空的 ways 一樣，在被使用之前
+  // 它的 set 下一次 miss 就替換它 (way 0)，而不是填入空的 way
+  static const size_t NONE = SIZE_MAX;
+  size_t zero_set;    // 那個 block 所在的 set，NONE 為已經被使用或替換
+  bool started;
+};
+
+// LFU, evict the block which is least frequently used, ties go to the lowest way
+class lfu_cache_sim_t : public cache_sim_t
+{
+ public:
+  lfu_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name,
+                  uint64_t sat = UINT32_MAX, uint64_t age_period = 0, bool lru_ties = false);
+  bool sets_independent() const { return age_period == 0; }   // aging counts the accesses of all sets
+ protected:
+  static const uint8_t NIL = 0xff;
+
+  struct bucket_t     // all blocks of a set with the same use count
+  {
+    uint64_t mask;    // ways in this bucket
+    uint32_t freq;    // use count of the blocks in this bucket
+    uint8_t prev, next;     // neighbouring buckets, ordered by 'freq'
+    uint8_t first, last;    // ways in this bucket, from LRU to MRU
+  };
+  struct header_t
+  {
+    uint32_t epoch;   // last aging epoch applied to this set
+    uint8_t first;    // bucket with the smallest use count
+    uint8_t free;     // list of unused buckets
+  };
+  struct way_t
+  {
+    uint8_t bucket;   // NIL when the way has never been filled
+    uint8_t prev, next;
+  };
+
+  bucket_t* buckets(size_t idx) { return (bucket_t*)set_meta(idx); }
+  header_t* header(size_t idx) { return (header_t*)(buckets(idx) + ways); }
+  way_t* way_links(size_t idx) { return (way_t*)(header(idx) + 1); }
+
+  uint64_t victimize(uint64_t addr);
+  void on_hit(size_t idx, size_t way);
+
+  void bucket_add(size_t idx, uint8_t b, size_t way);       // append 'way' as the MRU block of bucket 'b'
+  void bucket_remove(size_t idx, size_t way);               // free the bucket when it becomes empty
+  uint8_t bucket_new(size_t idx, uint8_t prev, uint32_t freq);  // insert an empty bucket after 'prev' (NIL: first)
+  void tick();              // count an access for aging
+  void age(size_t idx);     // apply the pending aging epochs to a set
+
+  uint64_t sat;             // use counts saturate at 'sat'
+  uint64_t age_period;      // halve all use counts every 'age_period' accesses, 0 disables aging
+  uint64_t age_count;
+  uint32_t epoch;
+  bool lru_ties;
+};
+
+// LFRU, check total used times first(LFU), if the same, then check recently used time(LRU)
+class lfru_cache_sim_t : public lfu_cache_sim_t
+{
+ public:
+  lfru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name,
+                   uint64_t sat = UINT32_MAX, uint64_t age_period = 0);
+};
+
+// tree-PLRU, a binary tree of (ways-1) bits per set points towards the pseudo least recently used way
+class plru_cache_sim_t : public cache_sim_t
+{
+ public:
+  plru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name);
+  bool sets_independent() const { return true; }
+ protected:
+  uint64_t victimize(uint64_t addr);
+  void on_hit(size_t idx, size_t way);
+  void touch(size_t idx, size_t way);   // point every node on the path of 'way' away from it
+};
+
+// bit-PLRU (MRU bits), one bit per way marks a recently used way, the victim is the lowest unmarked way
+class bit_plru_cache_sim_t : public cache_sim_t
+{
+ public:
+  bit_plru_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name);
+  bool sets_independent() const { return true; }
+ protected:
+  uint64_t victimize(uint64_t addr);
+  void on_hit(size_t idx, size_t way);
+  void touch(size_t idx, size_t way);
+};
+
+// RRIP, every way has an M-bit re-reference prediction value (RRPV), the victim is a way predicted
+// to be re-referenced in the distant future (RRPV == 2^M-1) and a hit predicts a near re-reference
+// (RRPV = 0). SRRIP inserts with a long prediction (2^M-2), BRRIP mostly with a distant one and
+// DRRIP picks between them with set dueling.
+class rrip_cache_sim_t : public cache_sim_t
+{
+ public:
+  enum mode_t { SRRIP, BRRIP, DRRIP };
+  rrip_cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name, mode_t mode,
+                   size_t rrpv_bits = 2, uint64_t bip_period = 32);
+  bool sets_independent() const { return mode == SRRIP; }   // BRRIP/DRRIP share 'bip_count' and 'psel'
+ protected:
+  static const uint32_t PSEL_MAX = 1023;  // 10-bit policy selector
+
+  uint64_t victimize(uint64_t addr);
+  void on_hit(size_t idx, size_t way);
+
+  // the RRPVs of a set are stored bit-sliced, plane k holds bit k of the RRPV of every way
+  uint64_t* planes(size_t idx) { return (uint64_t*)set_meta(idx); }
+  void set_rrpv(size_t idx, size_t way, uint64_t rrpv);
+  bool brrip_insert(size_t idx);    // does this insertion follow BRRIP
+  void policy_stats(stats_record_t& record);
+  void print_policy_stats();
+
+  mode_t mode;
+  size_t rrpv_bits;
+  uint64_t rrpv_max;
+  uint64_t bip_period;      // BRRIP inserts one in 'bip_period' blocks with a long prediction
+  uint64_t bip_count;
+  size_t leader_mask;       // DRRIP: set idx & leader_mask == 0 leads SRRIP, == leader_mask leads BRRIP
+  uint32_t psel;            // DRRIP: misses in SRRIP leaders count up, misses in BRRIP leaders count down
+  uint64_t follower_srrip;  // DRRIP: insertions into follower sets using each policy
+  uint64_t follower_brrip;
+};
+
+// Lock-free ring buffer for one producer thread and one consumer thread. 'head' is only written
+// by the producer and 'tail' only by the consumer, each side keeps a copy of the other's index and
+// rereads it only when the ring looks full (or empty).
+template <typename T>
+class spsc_ring_t
+{
+ public:
+  spsc_ring_t(size_t capacity)   // rounded up to a power of two
+    : head(0), tail(0), head_seen(0), tail_seen(0), closed(false)
+  {
+    size_t n = 1;
+    while (n < capacity)
+      n *= 2;
+    buf.resize(n);
+    mask = n - 1;
+  }
+
+  // producer: append up to 'n' items, returns how many fit
+  size_t push(const T* items, size_t n)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h + n - tail_seen > buf.size())
+      tail_seen = tail.load(std::memory_order_acquire);
+    n = std::min(n, buf.size() - (h - tail_seen));
+    for (size_t i = 0; i < n; i++)
+      buf[(h + i) & mask] = items[i];
+    head.store(h + n, std::memory_order_release);
+    return n;
+  }
+  // producer: append all 'n' items, waiting for the consumer while the ring is full
+  void push_all(const T* items, size_t n)
+  {
+    for (size_t done = 0; done < n; ) {
+      size_t k = push(items + done, n - done);
+      if (k == 0)
+        std::this_thread::yield();
+      done += k;
+    }
+  }
+  // producer: no more items will be pushed
+  void close() { closed.store(true, std::memory_order_release); }
+
+  // consumer: take up to 'n' items, returns how many were taken
+  size_t pop(T* items, size_t n)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t + n > head_seen)
+      head_seen = head.load(std::memory_order_acquire);
+    n = std::min(n, head_seen - t);
+    for (size_t i = 0; i < n; i++)
+      items[i] = buf[(t + i) & mask];
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+  // consumer: take up to 'n' items, waiting while the ring is empty, 0 once it is closed and drained
+  size_t pop_wait(T* items, size_t n)
+  {
+    for (;;) {
+      bool last = closed.load(std::memory_order_acquire);   // read before the last check of 'head'
+      size_t k = pop(items, n);
+      if (k || last)
+        return k;
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  std::vector<T> buf;
+  size_t mask;
+  // 每個 index 各自佔一條 64-byte cache line，用 padding 而不是 alignas(64)，
+  // 因為 C++11 的 new 不保證超過 alignof(max_align_t) 的對齊
+  char pad0[64];
+  std::atomic<size_t> head;   // next slot to write, producer
+  char pad1[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail;   // next slot to read, consumer
+  char pad2[64 - sizeof(std::atomic<size_t>)];
+  size_t head_seen;           // consumer's copy of 'head'
+  char pad3[64 - sizeof(size_t)];
+  size_t tail_seen;           // producer's copy of 'tail'
+  char pad4[64 - sizeof(size_t)];
+  std::atomic<bool> closed;
+};
+
+// Asynchronous simulation (the async field of --ic/--dc): trace() only queues the reference and one
+// consumer thread runs the whole hierarchy, I$ and D$ share it so the L2 still sees one ordered
+// stream. References are staged in small blocks before they go through the SPSC ring.
+class async_sim_t
+{
+ public:
+  static async_sim_t* open();   // every async cache uses the same consumer
+  static void close(async_sim_t* sim);
+  static void sync();           // wait until every queued reference has been simulated
+
+  void access(cache_sim_t* cache, uint64_t addr, size_t bytes, bool store)
+  {
+    put(cache, addr, bytes, store ? WRITE : READ);
+  }
+  void clean_invalidate(cache_sim_t* cache, uint64_t addr, size_t bytes, bool clean, bool inval)
+  {
+    put(cache, addr, bytes, CLEAN_INVAL | (clean ? CLEAN : 0) | (inval ? INVAL : 0));
+  }
+  void snapshot(cache_sim_t* cache, uint64_t position)
+  {
+    put(cache, position, 0, SNAPSHOT);
+  }
+
+ private:
+  enum { READ = 0, WRITE = 1, CLEAN_INVAL = 2, CLEAN = 4, INVAL = 8, SNAPSHOT = 16 };
+  struct ref_t
+  {
+    cache_sim_t* cache;
+    uint64_t addr;
+    uint32_t bytes;
+    uint32_t op;
+  };
+  static const size_t STAGE = 256;
+
+  async_sim_t();
+  ~async_sim_t();
+  void put(cache_sim_t* cache, uint64_t addr, size_t bytes, uint32_t op)
+  {
+    ref_t& r = stage[staged];
+    r.cache = cache;
+    r.addr = addr;
+    r.bytes = bytes;
+    r.op = op;
+    if (unlikely(++staged == STAGE))
+      flush();
+  }
+  void flush();     // push the staged references into the ring
+  void drain();     // flush and wait for the consumer to catch up
+  void run();       // consumer thread
+
+  static async_sim_t* instance;
+  int refs;
+  ref_t stage[STAGE];
+  size_t staged;
+  uint64_t produced;
+  std::atomic<uint64_t> consumed;
+  spsc_ring_t<ref_t> ring;
+  std::thread thread;
+};
+
+// Binary memory trace, written by cache_memtracer_t when its config has a trace=path field.
+// The file starts with the 8-byte magic "CSTRACE1" followed by one record per reference:
+//   varint(zigzag(addr - previous addr of the same type) << 3 | same_bytes << 2 | type)
+//   varint(bytes), only when same_bytes is 0 (the size differs from the previous one of the same type)
+// type is 0 load, 1 store, 2 fetch, varints are little-endian base 128.
+// Records are encoded into one buffer while a background thread writes the other one to the file.
+class trace_writer_t
+{
+ public:
+  static trace_writer_t* open(const std::string& path);   // I$ and D$ given the same path share one writer
+  static void close(trace_writer_t* writer);
+
+  void put(uint64_t addr, size_t bytes, access_type type)
+  {
+    if (unlikely(fill + MAX_RECORD > BUF_BYTES))
+      flip();
+    int t = type == LOAD ? 0 : type == STORE ? 1 : 2;
+    int64_t delta = addr - last_addr[t];
+    uint64_t key = ((uint64_t(delta) << 1) ^ uint64_t(delta >> 63)) << 3 | t;
+    last_addr[t] = addr;
+    if (bytes == last_bytes[t])
+      put_varint(key | 4);
+    else {
+      put_varint(key);
+      put_varint(bytes);
+      last_bytes[t] = bytes;
+    }
+  }
+
+ private:
+  static const size_t BUF_BYTES = 4 << 20;
+  static const size_t MAX_RECORD = 2 * 10;   // two varints of at most 10 bytes
+
+  trace_writer_t(const std::string& path);
+  ~trace_writer_t();
+  void put_varint(uint64_t v)
+  {
+    uint8_t* p = buf[cur] + fill;
+    while (v >= 0x80) {
+      *p++ = uint8_t(v) | 0x80;
+      v >>= 7;
+    }
+    *p++ = uint8_t(v);
+    fill = p - buf[cur];
+  }
+  void flip();      // hand the current buffer to the writer thread and continue in the other one
+  void run();       // writer thread
+
+  std::string path;
+  FILE* file;
+  int refs;         // cache_memtracer_t's using this writer
+  uint8_t* buf[2];
+  int cur;
+  size_t fill;
+  uint64_t last_addr[3];
+  size_t last_bytes[3];
+
+  std::thread thread;
+  std::mutex lock;
+  std::condition_variable cond;
+  const uint8_t* pending;   // buffer waiting to be written, NULL when the writer thread is idle
+  size_t pending_len;
+  bool done;
+};
+
+class cache_memtracer_t : public memtracer_t    // a derived class for tracing memory accesses and forwarding them to the cache for processing
+{
+ public:
+  cache_memtracer_t(const char* config, const char* name)
+    : recorder(NULL), async(NULL), instructions(0), inst_left(0)
+  {
+    // trace=path 與 async 不屬於 cache 本身的設定
+    std::string cache_config = config, path, unused;
+    take_config_field(cache_config, "trace", path);
+    bool use_async = take_config_field(cache_config, "async", unused);
+    cache = cache_sim_t::construct(cache_config.c_str(), name);
+    if (!path.empty())
+      recorder = trace_writer_t::open(path);
+    if (use_async)
+      async = async_sim_t::open();
+    inst_period = inst_left = cache->instruction_interval();
+  }
+  ~cache_memtracer_t()
+  {
+    if (async)
+      async_sim_t::close(async);    // finish the queued references before the stats are printed
+    if (inst_period)
+      cache->close_series(instructions);
+    if (recorder)
+      trace_writer_t::close(recorder);
+    delete cache;
+  }
+  void set_miss_handler(cache_sim_t* mh);
+  void clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool inval)
+  {
+    if (async)
+      async->clean_invalidate(cache, addr, bytes, clean, inval);
+    else
+      cache->clean_invalidate(addr, bytes, clean, inval);
+  }
+  void set_log(bool log)
+  {
+    cache->set_log(log);
+  }
+
+  // 從 config 中移除 key=value (或只有 key) 的欄位並把 value 放到 value，回傳是否有這個欄位
+  static bool take_config_field(std::string& config, const char* key, std::string& value);
+
+ protected:
+  void record(uint64_t addr, size_t bytes, access_type type)
+  {
+    if (unlikely(recorder != NULL))
+      recorder->put(addr, bytes, type);
+  }
+  void simulate(uint64_t addr, size_t bytes, bool store)
+  {
+    if (async)
+      async->access(cache, addr, bytes, store);
+    else
+      cache->access(addr, bytes, store);
+  }
+  void count_instruction()    // 每個 FETCH 是一個 instruction，interval=Ninst 時才需要
+  {
+    instructions++;
+    if (unlikely(--inst_left == 0)) {
+      inst_left = inst_period;
+      if (async)
+        async->snapshot(cache, instructions);
+      else
+        cache->snapshot(instructions);
+    }
+  }
+
+  cache_sim_t* cache;
+  trace_writer_t* recorder;   // 記錄 trace 到檔案，沒有 trace= 時為 NULL
+  async_sim_t* async;         // 非同步模擬，沒有 async 時為 NULL
+  uint64_t instructions;
+  uint64_t inst_period;       // interval=Ninst 的 N，沒有時為 0
+  uint64_t inst_left;
+};
+
+class icache_sim_t : public cache_memtracer_t   // derived classes implementing instruction caches, with methods for filtering and tracing specific types of memory accesses.
+{
+ public:
+  icache_sim_t(const char* config) : cache_memtracer_t(config, "I$") {}
+  bool interested_in_range(uint64_t UNUSED begin, uint64_t UNUSED end, access_type type)
+  {
+    return type == FETCH;
+  }
+  void trace(uint64_t addr, size_t bytes, access_type type)
+  {
+    if (type == FETCH) {
+      record(addr, bytes, type);
+      simulate(addr, bytes, false);
+      if (unlikely(inst_period != 0))
+        count_instruction();
+    }
+  }
+};
+
+class dcache_sim_t : public cache_memtracer_t   // derived classes implementing data caches, with methods for filtering and tracing specific types of memory accesses.
+{
+ public:
+  dcache_sim_t(const char* config) : cache_memtracer_t(config, "D$") {}
+  bool interested_in_range(uint64_t UNUSED begin, uint64_t UNUSED end, access_type type)
+  {
+    return type == LOAD || type == STORE || (type == FETCH && inst_period != 0);   // interval=Ninst 要數 instructions
+  }
+  void trace(uint64_t addr, size_t bytes, access_type type)
+  {
+    if (type == LOAD || type == STORE) {
+      record(addr, bytes, type);
+      simulate(addr, bytes, type == STORE);
+    }
+    else if (type == FETCH && unlikely(inst_period != 0))
+      count_instruction();
+  }
+};
+
+#endif
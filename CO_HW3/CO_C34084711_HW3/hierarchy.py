@@ -0,0 +1,99 @@
+import argparse
+import concurrent.futures
+import configparser
+import csv
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+from sweep import BUILD_DIR, compile_benchmark, load_records, record_trace
+
+# Simulates the whole cache hierarchy of the [hierarchy] section in config.conf in one run per
+# benchmark: L1I and L1D are --ic and --dc, L2, L3, ... are chained below them in one --l2, each with
+# its own inclusion= (nine, inclusive or exclusive). Every level writes its counters to one stats=
+# file, the per-level report is printed and written to hierarchy_results.csv.
+# With --replay each benchmark is emulated once to record a trace and replayed with cachesim_replay.
+
+FIELDS = ("read_accesses", "write_accesses", "read_misses", "write_misses", "writebacks",
+          "back_invalidations", "victims_inserted", "miss_rate")
+
+
+def levels(config):
+    # the configs of L1I, L1D and of L2, L3, ... in order (configparser lowercases the keys)
+    section = config['hierarchy']
+    lower = sorted((int(m.group(1)), section[key]) for key in section for m in [re.fullmatch(r"l(\d+)", key)] if m)
+    if "l1i" not in section or "l1d" not in section or [n for n, _ in lower] != list(range(2, 2 + len(lower))):
+        sys.exit("[hierarchy] needs L1I, L1D and L2, L3, ... without gaps")
+    return section["l1i"], section["l1d"], [c for _, c in lower]
+
+
+def run_benchmark(benchmark, program, hierarchy, pk, replay):
+    l1i, l1d, lower = hierarchy
+    fd, stats_path = tempfile.mkstemp(suffix=".json", dir=BUILD_DIR)
+    os.close(fd)
+    fields = ":stats=" + stats_path + ":bench=" + os.path.splitext(benchmark)[0]
+    options = ["--ic=" + l1i + fields, "--dc=" + l1d + fields]
+    if lower:
+        options.append("--l2=" + ",".join(level + fields for level in lower))
+    if replay:
+        command = ["./cachesim_replay"] + options + [program]
+    else:
+        command = ["spike"] + options + ["--isa=RV64GC", pk, program]
+    output = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    records = load_records(stats_path)
+    os.remove(stats_path)
+    if output.returncode != 0 or not records:
+        return benchmark, None, output.stderr.strip().split("\n")[0]
+    return benchmark, records, None
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="multi-level cache hierarchy simulation")
+    parser.add_argument("--pk", default="/home/ubuntu/riscv/riscv64-unknown-elf/bin/pk")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--replay", action="store_true", help="record each benchmark once and replay the trace")
+    parser.add_argument("--output", default="hierarchy_results.csv")
+    args = parser.parse_args()
+
+    config = configparser.ConfigParser()
+    config.read('config.conf')
+    hierarchy = levels(config)
+
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    sources = sorted(os.path.join("benchmark", f) for f in os.listdir("benchmark") if f.endswith(".c"))
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        programs = list(pool.map(compile_benchmark, sources))
+        if args.replay:
+            subprocess.run(["make", "cachesim_replay"], check=True, stdout=subprocess.DEVNULL)
+            programs = list(pool.map(lambda b: record_trace(b, args.pk), programs))
+        runs = pool.map(lambda j: run_benchmark(os.path.basename(j[0]), j[1], hierarchy, args.pk, args.replay),
+                        zip(sources, programs))
+        results = []
+        for benchmark, records, error in runs:
+            if error is not None:
+                print("%s: %s" % (benchmark, error), file=sys.stderr)
+            results.append((benchmark, records or []))
+
+    with open(args.output, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["Benchmark", "Cache", "Config"] + list(FIELDS))
+        for benchmark, records in results:
+            for r in records:
+                writer.writerow([benchmark, r["cache"], r["config"]] + [r.get(key, "") for key in FIELDS])
+
+    # one row per level and benchmark, from I$ and D$ down to the last level
+    print("\n=======================================================================")
+    print("L1I %s  L1D %s" % hierarchy[:2] + "".join("  L%d %s" % (n, c) for n, c in enumerate(hierarchy[2], 2)))
+    print("%-6s%-14s%12s%12s%10s%12s%12s" % ("Cache", "Benchmark", "Accesses", "Misses", "Miss(%)", "Writebacks", "BackInval"))
+    names = sorted(dict.fromkeys(r["cache"] for _, records in results for r in records),
+                   key=lambda name: {"I$": 0, "D$": 1}.get(name, 2 + int(re.sub(r"\D", "", name) or 0)))
+    for name in names:
+        for benchmark, records in results:
+            r = next((r for r in records if r["cache"] == name), None)
+            if r:
+                print("%-6s%-14s%12d%12d%10.4f%12d%12d" % (
+                    name, os.path.splitext(benchmark)[0], r["read_accesses"] + r["write_accesses"],
+                    r["read_misses"] + r["write_misses"], r["miss_rate"], r["writebacks"], r.get("back_invalidations", 0)))
+    print("Results: " + args.output)
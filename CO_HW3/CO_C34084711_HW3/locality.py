@@ -0,0 +1,98 @@
+import argparse
+import concurrent.futures
+import csv
+import os
+import subprocess
+import sys
+import tempfile
+
+from sweep import BUILD_DIR, compile_benchmark, record_trace
+
+# Compares the locality of the benchmarks without sweeping cache sizes: each benchmark is recorded
+# once, cachesim_replay --reuse computes the LRU reuse distance histograms of its I$ and D$
+# references, and the miss rate of a fully associative LRU cache of every power-of-two size follows
+# from them. The miss ratio curves are printed and written to locality_results.csv.
+# --sample=N follows only about one in N lines (SHARDS) for a faster, approximate curve. The sampled
+# distances are scaled by N and do not resolve smaller distances, so the curve starts at N lines.
+
+
+def histogram(trace, blocksize, sample):
+    # {stream: [cold, {distance: refs}]} from the --reuse-out CSV of one trace
+    fd, path = tempfile.mkstemp(suffix=".csv", dir=BUILD_DIR)
+    os.close(fd)
+    option = "--reuse=%d:%d" % (blocksize, max(1, sample))
+    output = subprocess.run(["./cachesim_replay", option, "--reuse-out=" + path, trace],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    streams = {}
+    if output.returncode == 0:
+        with open(path) as f:
+            for row in csv.DictReader(f):
+                entry = streams.setdefault(row["stream"], [0, {}])
+                if row["distance"] == "cold":
+                    entry[0] = int(row["refs"])
+                else:
+                    entry[1][int(row["distance"])] = int(row["refs"])
+    os.remove(path)
+    if output.returncode != 0:
+        sys.exit("%s: %s" % (trace, output.stderr.strip().split("\n")[0]))
+    return streams
+
+
+def miss_rates(cold, refs, sizes):
+    # miss rate (%) of a fully associative LRU cache of each number of lines in 'sizes' (ascending)
+    total = cold + sum(refs.values())
+    distances = sorted(refs)
+    rates, hits, i = [], 0, 0
+    for lines in sizes:
+        while i < len(distances) and distances[i] < lines:
+            hits += refs[distances[i]]
+            i += 1
+        rates.append(100.0 * (total - hits) / total if total else 0.0)
+    return rates
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="miss ratio curves of the benchmarks from reuse distances")
+    parser.add_argument("--pk", default="/home/ubuntu/riscv/riscv64-unknown-elf/bin/pk")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--blocksize", type=int, default=64)
+    parser.add_argument("--max-size", type=int, default=1 << 20, help="largest cache size in bytes (default 1 MiB)")
+    parser.add_argument("--sample", type=int, default=0, metavar="N", help="follow about one in N lines (SHARDS)")
+    parser.add_argument("--output", default="locality_results.csv")
+    args = parser.parse_args()
+
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    sources = sorted(os.path.join("benchmark", f) for f in os.listdir("benchmark") if f.endswith(".c"))
+    subprocess.run(["make", "cachesim_replay"], check=True, stdout=subprocess.DEVNULL)
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        binaries = list(pool.map(compile_benchmark, sources))
+        traces = list(pool.map(lambda b: record_trace(b, args.pk), binaries))
+        histograms = list(pool.map(lambda t: histogram(t, args.blocksize, args.sample), traces))
+
+    sizes, lines = [], 1
+    while lines < args.sample:
+        lines *= 2
+    while lines * args.blocksize <= args.max_size:
+        sizes.append(lines)
+        lines *= 2
+    curves = []
+    for source, streams in zip(sources, histograms):
+        benchmark = os.path.splitext(os.path.basename(source))[0]
+        for stream in ("I$", "D$"):
+            if stream in streams:
+                curves.append((benchmark, stream, miss_rates(*streams[stream], sizes)))
+
+    with open(args.output, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["Benchmark", "Stream", "Bytes", "miss_rate"])
+        for benchmark, stream, rates in curves:
+            for lines, rate in zip(sizes, rates):
+                writer.writerow([benchmark, stream, lines * args.blocksize, rate])
+
+    print("\n=======================================================================")
+    print("Fully associative LRU Miss Rate (%%), blocksize %d%s" % (
+        args.blocksize, ", 1 in %d lines sampled" % args.sample if args.sample > 1 else ""))
+    print("%10s" % "Bytes" + "".join("%14s" % ("%s %s" % (b, s)) for b, s, _ in curves))
+    for k, lines in enumerate(sizes):
+        print("%10d" % (lines * args.blocksize) + "".join("%14.4f" % rates[k] for _, _, rates in curves))
+    print("Results: " + args.output)
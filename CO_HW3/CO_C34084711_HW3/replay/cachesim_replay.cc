@@ -0,0 +1,264 @@
+// See LICENSE for license details.
+
+// Replays a trace recorded with trace=path (make record) through the cache model without Spike,
+// e.g. cachesim_replay --dc=64:4:32:lru a.trace
+// The caches, the L2 shared by I$ and D$ and the printed stats are the same as in a Spike run.
+// --lru-table=maxsets:maxways:blocksize[,blocksize...] also prints the LRU miss rate of every
+// power-of-two set count and every associativity up to the given ones, for I$ and D$ references,
+// computed in the same single pass.
+// --reuse=blocksize[:N] prints the fully associative LRU reuse distance histogram and miss ratio curve
+// of the I$ and of the D$ references, following only about one in N lines (SHARDS) for long traces,
+// which estimates the curve from N lines up; --reuse-out=F also writes the histograms to the CSV
+// file F (with N > 1 the sampled references and their distances scaled by N).
+// --threads=N splits the sets of a single cache (--ic or --dc, no L2) among N threads, the results
+// are identical to a serial replay.
+
+#include "cachesim.h"
+#include "trace_reader.h"
+#include "stack_distance.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+static void usage()
+{
+  std::cerr << "usage: cachesim_replay [--ic=config] [--dc=config] [--l2=config] [--log-cache-miss]" << std::endl;
+  std::cerr << "                       [--lru-table=maxsets:maxways:blocksize[,blocksize...]]" << std::endl;
+  std::cerr << "                       [--reuse=blocksize[:N]] [--reuse-out=file.csv] trace" << std::endl;
+  std::cerr << "       cachesim_replay --threads=N (--ic=config | --dc=config) trace" << std::endl;
+  exit(1);
+}
+
+// Every worker owns a copy of the cache and simulates the sets in its range, which needs a policy
+// whose sets do not share state (cache_sim_t::sets_independent). The main thread decodes the trace
+// and hands each worker the references of its sets, in trace order, through an SPSC ring.
+static void replay_parallel(trace_reader_t& trace, const char* config, const char* name, bool fetch, size_t nthreads)
+{
+  cache_sim_t* total = cache_sim_t::construct(config, name);
+  // a prefetcher sees the references of all sets, a victim or miss cache and the shadow cache of
+  // classify hold blocks of all sets
+  if (!total->sets_independent() || total->has_prefetcher() || total->has_side_buffer() || total->classifies()) {
+    std::cerr << "--threads needs a set-associative fifo, lru, plru, bitplru or srrip cache, or lfu/lfru without age=," << std::endl;
+    std::cerr << "and no prefetch=, victim=, misscache= or classify" << std::endl;
+    exit(1);
+  }
+  if (total->has_series()) {
+    std::cerr << "--threads cannot write interval statistics (series=)" << std::endl;
+    exit(1);
+  }
+  nthreads = std::min(nthreads, total->num_sets());
+
+  size_t sets = total->num_sets();
+  uint64_t addr = 0;
+  uint32_t bytes;
+  access_type type;
+  // only the worker of the first reference fills the cache's first block (lru_cache_sim_t)
+  while (trace.next(addr, bytes, type) && (type == FETCH) != fetch)
+    ;
+  size_t first = total->set_index(addr) * nthreads / sets;
+  trace.rewind();
+
+  const size_t STAGE = 256, BATCH = 4096;
+  std::vector<cache_sim_t*> caches(nthreads);
+  std::vector<spsc_ring_t<mem_ref>*> rings(nthreads);
+  std::vector<std::vector<mem_ref> > stage(nthreads);
+  std::vector<std::thread> workers;
+  for (size_t w = 0; w < nthreads; w++) {
+    caches[w] = cache_sim_t::construct(config, name);
+    if (w != first)
+      caches[w]->skip_first_fill();
+    rings[w] = new spsc_ring_t<mem_ref>(64 * BATCH);
+    stage[w].reserve(STAGE);
+    workers.push_back(std::thread([w, &caches, &rings] {
+      std::vector<mem_ref> batch(BATCH);
+      while (size_t n = rings[w]->pop_wait(batch.data(), BATCH))
+        caches[w]->access_batch(batch.data(), n);
+    }));
+  }
+
+  while (trace.next(addr, bytes, type)) {
+    if ((type == FETCH) != fetch)
+      continue;
+    size_t w = total->set_index(addr) * nthreads / sets;   // contiguous set ranges
+    stage[w].push_back(mem_ref{addr, bytes, type == STORE});
+    if (stage[w].size() == STAGE) {
+      rings[w]->push_all(stage[w].data(), STAGE);
+      stage[w].clear();
+    }
+  }
+
+  for (size_t w = 0; w < nthreads; w++) {
+    rings[w]->push_all(stage[w].data(), stage[w].size());
+    rings[w]->close();
+  }
+  for (size_t w = 0; w < nthreads; w++) {
+    workers[w].join();
+    total->take_stats(*caches[w]);
+    delete caches[w];
+    delete rings[w];
+  }
+  delete total;
+}
+
+int main(int argc, char** argv)
+{
+  const char *ic_config = NULL, *dc_config = NULL, *l2_config = NULL, *path = NULL, *reuse_path = NULL;
+  std::vector<lru_table_t*> i_tables, d_tables;
+  reuse_histogram_t *i_reuse = NULL, *d_reuse = NULL;
+  bool log = false;
+  size_t threads = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--ic=", 5) == 0)
+      ic_config = argv[i] + 5;
+    else if (strncmp(argv[i], "--dc=", 5) == 0)
+      dc_config = argv[i] + 5;
+    else if (strncmp(argv[i], "--l2=", 5) == 0)
+      l2_config = argv[i] + 5;
+    else if (strncmp(argv[i], "--threads=", 10) == 0) {
+      threads = atoi(argv[i] + 10);
+      if (threads == 0)
+        usage();
+    }
+    else if (strcmp(argv[i], "--log-cache-miss") == 0)
+      log = true;
+    else if (strncmp(argv[i], "--lru-table=", 12) == 0) {
+      char* p = argv[i] + 12;
+      size_t max_sets = strtoul(p, &p, 10);
+      size_t max_ways = *p == ':' ? strtoul(p + 1, &p, 10) : 0;
+      if (*p != ':' || max_sets == 0 || (max_sets & (max_sets-1)) || max_ways == 0)
+        usage();
+      do {
+        size_t linesz = strtoul(p + 1, &p, 10);
+        if (linesz < 8 || (linesz & (linesz-1)))
+          usage();
+        i_tables.push_back(new lru_table_t(max_sets, max_ways, linesz));
+        d_tables.push_back(new lru_table_t(max_sets, max_ways, linesz));
+      } while (*p == ',');
+      if (*p)
+        usage();
+    }
+    else if (strncmp(argv[i], "--reuse=", 8) == 0) {
+      char* p = argv[i] + 8;
+      size_t linesz = strtoul(p, &p, 10);
+      size_t period = *p == ':' ? strtoul(p + 1, &p, 10) : 1;
+      if (linesz < 8 || (linesz & (linesz-1)) || period == 0 || *p || i_reuse)
+        usage();
+      i_reuse = new reuse_histogram_t(linesz, period);
+      d_reuse = new reuse_histogram_t(linesz, period);
+    }
+    else if (strncmp(argv[i], "--reuse-out=", 12) == 0)
+      reuse_path = argv[i] + 12;
+    else if (argv[i][0] != '-' && !path)
+      path = argv[i];
+    else
+      usage();
+  }
+  if (!path || (!ic_config && !dc_config && d_tables.empty() && !d_reuse) || (reuse_path && !d_reuse))
+    usage();
+
+  if (threads > 1) {
+    if (l2_config || log || !d_tables.empty() || d_reuse || (ic_config && dc_config) || (!ic_config && !dc_config))
+      usage();
+    trace_reader_t trace(path);
+    replay_parallel(trace, ic_config ? ic_config : dc_config, ic_config ? "I$" : "D$", ic_config != NULL, threads);
+    return 0;
+  }
+
+  // 與 spike 相同：I$ 和 D$ 的 miss 都交給同一個 L2
+  cache_sim_t* ic = ic_config ? cache_sim_t::construct(ic_config, "I$") : NULL;
+  cache_sim_t* dc = dc_config ? cache_sim_t::construct(dc_config, "D$") : NULL;
+  cache_sim_t* l2 = l2_config ? cache_sim_t::construct(l2_config, "L2$") : NULL;
+  if (ic && l2) ic->set_miss_handler(l2);
+  if (dc && l2) dc->set_miss_handler(l2);
+  if (ic) ic->set_log(log);
+  if (dc) dc->set_log(log);
+  if (l2) l2->set_log(log);
+
+  // consecutive references to the same cache are handed over as one batch, which keeps the
+  // order every level sees exactly as in the trace
+  const size_t BATCH = 4096;
+  std::vector<mem_ref> batch;
+  batch.reserve(BATCH);
+  cache_sim_t* target = NULL;
+  auto flush = [&]() {
+    if (!batch.empty())
+      target->access_batch(batch.data(), batch.size());
+    batch.clear();
+  };
+
+  // interval=Ninst: every fetch is an instruction, as in a Spike run
+  cache_sim_t* counted[] = { ic, dc };
+  uint64_t inst_period[] = { ic ? ic->instruction_interval() : 0, dc ? dc->instruction_interval() : 0 };
+
+  trace_reader_t trace(path);
+  uint64_t addr;
+  uint32_t bytes;
+  access_type type;
+  uint64_t fetches = 0, data_refs = 0;
+  while (trace.next(addr, bytes, type)) {
+    std::vector<lru_table_t*>& tables = type == FETCH ? i_tables : d_tables;
+    for (size_t t = 0; t < tables.size(); t++)
+      tables[t]->access(addr);
+    if (d_reuse)
+      (type == FETCH ? i_reuse : d_reuse)->access(addr);
+    (type == FETCH ? fetches : data_refs)++;
+
+    cache_sim_t* cache = type == FETCH ? ic : dc;
+    if (cache) {
+      if (cache != target || batch.size() == BATCH) {
+        flush();
+        target = cache;
+      }
+      batch.push_back(mem_ref{addr, bytes, type == STORE});
+    }
+
+    if (type == FETCH)
+      for (int c = 0; c < 2; c++)
+        if (inst_period[c] && fetches % inst_period[c] == 0) {
+          flush();
+          counted[c]->snapshot(fetches);
+        }
+  }
+  flush();
+  for (int c = 0; c < 2; c++)
+    if (inst_period[c])
+      counted[c]->close_series(fetches);
+
+  // spike 結束時依 L2、D$、I$ 的順序印出統計
+  delete l2;
+  delete dc;
+  delete ic;
+
+  for (size_t t = 0; t < d_tables.size(); t++) {
+    if (fetches)
+      i_tables[t]->print("I$");
+    if (data_refs)
+      d_tables[t]->print("D$");
+    delete i_tables[t];
+    delete d_tables[t];
+  }
+
+  if (d_reuse) {
+    if (fetches)
+      i_reuse->print("I$");
+    if (data_refs)
+      d_reuse->print("D$");
+    if (reuse_path) {
+      FILE* f = fopen(reuse_path, "w");
+      if (!f) {
+        std::cerr << "cannot open " << reuse_path << std::endl;
+        return 1;
+      }
+      fprintf(f, "stream,blocksize,distance,refs\n");
+      i_reuse->write_csv(f, "I$");
+      d_reuse->write_csv(f, "D$");
+      fclose(f);
+    }
+    delete i_reuse;
+    delete d_reuse;
+  }
+  return 0;
+}
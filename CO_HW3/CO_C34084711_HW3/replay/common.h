@@ -0,0 +1,19 @@
+// See LICENSE for license details.
+
+// Minimal stand-in for Spike's riscv/common.h, just what cachesim.h uses,
+// so the cache model can be built without a Spike tree.
+
+#ifndef _RISCV_COMMON_H
+#define _RISCV_COMMON_H
+
+#ifdef __GNUC__
+# define likely(x) __builtin_expect(x, 1)
+# define unlikely(x) __builtin_expect(x, 0)
+#else
+# define likely(x) (x)
+# define unlikely(x) (x)
+#endif
+
+#define UNUSED __attribute__((unused))
+
+#endif
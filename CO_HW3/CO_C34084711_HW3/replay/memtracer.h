@@ -0,0 +1,28 @@
+// See LICENSE for license details.
+
+// Minimal stand-in for Spike's riscv/memtracer.h, the interface cache_memtracer_t implements.
+
+#ifndef _MEMTRACER_H
+#define _MEMTRACER_H
+
+#include <cstdint>
+#include <cstddef>
+
+enum access_type {
+  LOAD,
+  STORE,
+  FETCH,
+};
+
+class memtracer_t
+{
+ public:
+  memtracer_t() {}
+  virtual ~memtracer_t() {}
+
+  virtual bool interested_in_range(uint64_t begin, uint64_t end, access_type type) = 0;
+  virtual void trace(uint64_t addr, size_t bytes, access_type type) = 0;
+  virtual void clean_invalidate(uint64_t addr, size_t bytes, bool clean, bool inval) = 0;
+};
+
+#endif
@@ -0,0 +1,254 @@
+// See LICENSE for license details.
+
+#ifndef _CACHESIM_STACK_DISTANCE_H
+#define _CACHESIM_STACK_DISTANCE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Numbers the distinct lines of a stream 0, 1, 2, ... so per-line state can live in plain vectors.
+class line_ids_t
+{
+ public:
+  uint32_t operator()(uint64_t line)
+  {
+    return ids.emplace(line, uint32_t(ids.size())).first->second;
+  }
+  size_t size() const { return ids.size(); }
+ private:
+  std::unordered_map<uint64_t, uint32_t> ids;
+};
+
+// LRU stack distances of a stream of line addresses, per set for a given power-of-two number of sets:
+// the distance of a reference is the number of distinct lines of its set referenced since the
+// previous reference to the same line, so it hits in a 'sets'-set LRU cache iff distance < ways.
+// Every set numbers its references with a local clock and keeps a Fenwick tree with a mark at the
+// last reference of every line, the distance is the number of marks after the previous reference.
+// When the clock runs out the live marks are renumbered, so a reference is O(log n) amortized.
+class stack_distance_t
+{
+ public:
+  static const uint64_t COLD = UINT64_MAX;   // first reference to a line
+
+  stack_distance_t(size_t sets) : set(sets) {}
+
+  // 'id' is the line's number from line_ids_t
+  uint64_t access(uint64_t line, uint32_t id)
+  {
+    set_t& s = set[line & (set.size()-1)];
+    if (s.now == s.id.size())
+      compact(s);
+    if (id >= when.size())
+      when.resize(std::max<size_t>(2 * when.size(), id + 1), uint32_t(NEVER));
+
+    uint64_t distance = COLD;
+    uint32_t prev = when[id];
+    if (prev != NEVER) {
+      distance = s.prefix(s.now) - s.prefix(prev + 1);
+      s.add(prev, -1);
+      s.id[prev] = NEVER;
+    }
+    s.add(s.now, 1);
+    s.id[s.now] = id;
+    when[id] = s.now++;
+    return distance;
+  }
+
+ private:
+  static const uint32_t NEVER = UINT32_MAX;
+
+  struct set_t
+  {
+    set_t() : now(0) {}
+    std::vector<int32_t> tree;    // Fenwick tree over the local clock, 1-based
+    std::vector<uint32_t> id;     // line referenced at each tick, NEVER once referenced again
+    uint32_t now;
+
+    int32_t prefix(uint32_t n) const   // marks in ticks [0, n)
+    {
+      int32_t sum = 0;
+      for (; n > 0; n &= n - 1)
+        sum += tree[n];
+      return sum;
+    }
+    void add(uint32_t i, int32_t v)
+    {
+      for (i++; i < tree.size(); i += i & -i)
+        tree[i] += v;
+    }
+  };
+
+  void compact(set_t& s)
+  {
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < s.now; i++)
+      if (s.id[i] != NEVER) {
+        s.id[live] = s.id[i];
+        when[s.id[i]] = live++;
+      }
+    size_t cap = std::max<size_t>(64, 2 * live);
+    s.id.resize(cap);
+    std::fill(s.id.begin() + live, s.id.end(), uint32_t(NEVER));
+    s.tree.assign(cap + 1, 0);
+    for (uint32_t i = 1; i <= cap; i++) {   // linear-time Fenwick build
+      s.tree[i] += i <= live;
+      size_t up = i + (i & -i);
+      if (up <= cap)
+        s.tree[up] += s.tree[i];
+    }
+    s.now = live;
+  }
+
+  std::vector<set_t> set;
+  std::vector<uint32_t> when;   // tick of the last reference to each line, by id
+};
+
+// LRU miss counts of every power-of-two set count up to 'max_sets' and every associativity up to
+// 'max_ways' for one block size, from a single pass (Mattson et al. / Cheetah).
+class lru_table_t
+{
+ public:
+  lru_table_t(size_t max_sets, size_t _max_ways, size_t linesz)
+    : max_ways(_max_ways), line_shift(__builtin_ctzll(linesz)), accesses(0)
+  {
+    for (size_t sets = 1; sets <= max_sets; sets *= 2) {
+      levels.push_back(stack_distance_t(sets));
+      hits.push_back(std::vector<uint64_t>(max_ways, 0));
+    }
+  }
+
+  void access(uint64_t addr)
+  {
+    uint64_t line = addr >> line_shift;
+    uint32_t id = ids(line);
+    accesses++;
+    for (size_t k = 0; k < levels.size(); k++) {
+      uint64_t distance = levels[k].access(line, id);
+      if (distance < max_ways)
+        hits[k][distance]++;   // a hit in every cache of 2^k sets with more than 'distance' ways
+    }
+  }
+
+  void print(const char* name)
+  {
+    printf("%s LRU Miss Rate, blocksize %d, %llu accesses\n", name, 1 << line_shift, (unsigned long long)accesses);
+    printf("%9s", "sets\\ways");
+    for (size_t w = 1; w <= max_ways; w++)
+      printf("%9zu", w);
+    printf("\n");
+    for (size_t k = 0; k < levels.size(); k++) {
+      printf("%9zu", size_t(1) << k);
+      uint64_t hit = 0;
+      for (size_t w = 1; w <= max_ways; w++) {
+        hit += hits[k][w - 1];
+        printf("%8.3f%%", accesses ? 100.0 * (accesses - hit) / accesses : 0.0);
+      }
+      printf("\n");
+    }
+  }
+
+ private:
+  size_t max_ways;
+  size_t line_shift;
+  uint64_t accesses;
+  line_ids_t ids;
+  std::vector<stack_distance_t> levels;
+  std::vector<std::vector<uint64_t> > hits;   // hits[k][d]: references of stack distance d with 2^k sets
+};
+
+// Fully associative LRU reuse (stack) distance histogram of one reference stream at line granularity:
+// the distance of a reference is the number of distinct lines referenced since the previous
+// reference to the same line (stack_distance_t with a single set), so a reference hits in every
+// fully associative LRU cache of more than 'distance' lines, and one histogram gives the miss ratio
+// curve of all sizes. With 'period' > 1 only the lines whose hash is 0 mod 'period' are followed
+// (SHARDS, Waldspurger et al. FAST '15) and their distances are scaled by 'period': a sampled distance
+// d stands for about d*period to (d+1)*period - 1 lines, so caches of fewer than 'period' lines cannot
+// be told apart (all reuses between two sampled references count as hits in them).
+class reuse_histogram_t
+{
+ public:
+  reuse_histogram_t(size_t linesz, uint64_t _period)
+    : line_shift(__builtin_ctzll(linesz)), period(_period), stack(1), accesses(0), sampled(0), cold(0) {}
+
+  void access(uint64_t addr)
+  {
+    uint64_t line = addr >> line_shift;
+    accesses++;
+    if (period > 1 && hash(line) % period != 0)
+      return;
+    sampled++;
+    uint64_t distance = stack.access(line, ids(line));
+    if (distance == stack_distance_t::COLD) {
+      cold++;
+      return;
+    }
+    distance *= period;
+    if (distance >= refs.size())
+      refs.resize(std::max<size_t>(2 * refs.size(), distance + 1), 0);
+    refs[distance]++;
+  }
+
+  // one row per power-of-two number of lines: the references whose distance is in [lines/2, lines)
+  // and the miss rate of a fully associative LRU cache of that many lines; when sampled the first
+  // row is the smallest size of at least 'period' lines and counts every shorter distance
+  void print(const char* name)
+  {
+    printf("%s Reuse Distance, blocksize %d, %llu accesses", name, 1 << line_shift, (unsigned long long)accesses);
+    if (period > 1)
+      printf(", 1 in %llu lines sampled (%llu accesses)", (unsigned long long)period, (unsigned long long)sampled);
+    printf("\n%10s%12s%12s%10s\n", "lines", "bytes", "refs", "miss");
+    uint64_t hits = 0, prev = 0;
+    for (uint64_t lines = min_lines(); ; lines *= 2) {
+      uint64_t bucket = 0;
+      for (uint64_t d = prev; d < lines && d < refs.size(); d++)
+        bucket += refs[d];
+      hits += bucket;
+      prev = lines;
+      printf("%10llu%12llu%12llu%9.3f%%\n", (unsigned long long)lines, (unsigned long long)lines << line_shift,
+             (unsigned long long)bucket, sampled ? 100.0 * (sampled - hits) / sampled : 0.0);
+      if (lines >= refs.size())
+        break;
+    }
+    printf("%10s%12s%12llu\n", "cold", "", (unsigned long long)cold);
+  }
+
+  // the histogram as CSV rows stream,blocksize,distance,refs, the first references have distance "cold";
+  // with period > 1 these are the sampled references with their scaled distances, not exact counts
+  void write_csv(FILE* f, const char* name)
+  {
+    fprintf(f, "%s,%d,cold,%llu\n", name, 1 << line_shift, (unsigned long long)cold);
+    for (size_t d = 0; d < refs.size(); d++)
+      if (refs[d])
+        fprintf(f, "%s,%d,%zu,%llu\n", name, 1 << line_shift, d, (unsigned long long)refs[d]);
+  }
+
+ private:
+  uint64_t min_lines() const    // smallest power-of-two cache the (sampled) distances resolve
+  {
+    uint64_t lines = 1;
+    while (lines < period)
+      lines *= 2;
+    return lines;
+  }
+  static uint64_t hash(uint64_t line)   // splitmix64 finalizer, neighboring lines are sampled independently
+  {
+    line = (line ^ (line >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    line = (line ^ (line >> 27)) * 0x94d049bb133111ebULL;
+    return line ^ (line >> 31);
+  }
+
+  size_t line_shift;
+  uint64_t period;
+  line_ids_t ids;
+  stack_distance_t stack;
+  uint64_t accesses;
+  uint64_t sampled;   // references to the followed lines
+  uint64_t cold;
+  std::vector<uint64_t> refs;   // refs[d]: followed references of (scaled) distance d
+};
+
+#endif
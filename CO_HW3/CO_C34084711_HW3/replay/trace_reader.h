@@ -0,0 +1,96 @@
+// See LICENSE for license details.
+
+#ifndef _CACHESIM_TRACE_READER_H
+#define _CACHESIM_TRACE_READER_H
+
+#include "memtracer.h"
+#include "common.h"
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Reads a trace written by trace_writer_t (see cachesim.h for the format), the file is memory-mapped
+// and decoded in place.
+class trace_reader_t
+{
+ public:
+  trace_reader_t(const char* path) : base(NULL), size(0)
+  {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      std::cerr << "cannot open trace file " << path << std::endl;
+      exit(1);
+    }
+    size = st.st_size;
+    if (size > 0) {
+      base = (const uint8_t*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (base == MAP_FAILED) {
+        std::cerr << "cannot map trace file " << path << std::endl;
+        exit(1);
+      }
+      madvise((void*)base, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    if (size < 8 || memcmp(base, "CSTRACE1", 8) != 0) {
+      std::cerr << path << " is not a cache trace" << std::endl;
+      exit(1);
+    }
+    rewind();
+  }
+  ~trace_reader_t()
+  {
+    if (base)
+      munmap((void*)base, size);
+  }
+
+  void rewind()
+  {
+    p = base + 8;
+    memset(last_addr, 0, sizeof(last_addr));
+    memset(last_bytes, 0, sizeof(last_bytes));
+  }
+
+  // decode the next reference, false at the end of the trace
+  bool next(uint64_t& addr, uint32_t& bytes, access_type& type)
+  {
+    if (unlikely(p >= base + size))
+      return false;
+    uint64_t key = get_varint();
+    int t = key & 3;
+    uint64_t z = key >> 3;
+    last_addr[t] += (z >> 1) ^ -(z & 1);
+    if (!(key & 4))
+      last_bytes[t] = get_varint();
+    addr = last_addr[t];
+    bytes = last_bytes[t];
+    type = t == 0 ? LOAD : t == 1 ? STORE : FETCH;
+    return true;
+  }
+
+ private:
+  uint64_t get_varint()
+  {
+    uint64_t v = 0;
+    for (int shift = 0; p < base + size; shift += 7) {
+      uint8_t b = *p++;
+      v |= uint64_t(b & 0x7f) << shift;
+      if (b < 0x80)
+        break;
+    }
+    return v;
+  }
+
+  const uint8_t* base;
+  size_t size;
+  const uint8_t* p;
+  uint64_t last_addr[3];
+  uint32_t last_bytes[3];
+};
+
+#endif
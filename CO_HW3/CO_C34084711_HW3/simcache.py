@@ -0,0 +1,118 @@
+import hashlib
+import json
+import os
+import re
+import subprocess
+
+# Content-addressed cache of simulation results, shared by test.py and sweep.py. A result is stored
+# under the hash of everything it depends on:
+#   - the program: the benchmark binary (Spike runs) or the recorded trace (cachesim_replay runs)
+#   - the cache configuration string, e.g. "64:4:32:lru"
+#   - the source of the policy: the parts of cachesim.cc/.h shared by all policies plus the
+#     classes of that policy, so editing one policy only invalidates that policy's results
+#   - the simulator: the Spike version, or "replay" for cachesim_replay
+#   - FORMAT, the layout of the stored stats (the stats= record of the cache)
+# Spike runs assume the installed Spike was built from the current cachesim.cc/.h (make install).
+
+CACHE_DIR = ".simcache"
+FORMAT = 2
+SOURCES = ("cachesim.h", "cachesim.cc")
+
+# classes implementing each policy, everything else in SOURCES is shared
+POLICY_CLASSES = {
+    "fifo": ["fifo_cache_sim_t"],
+    "lru": ["lru_cache_sim_t"],
+    "lfu": ["lfu_cache_sim_t"],
+    "lfru": ["lfu_cache_sim_t", "lfru_cache_sim_t"],
+    "self": ["lfu_cache_sim_t", "lfru_cache_sim_t"],
+    "plru": ["plru_cache_sim_t"],
+    "bitplru": ["bit_plru_cache_sim_t"],
+    "srrip": ["rrip_cache_sim_t"],
+    "brrip": ["rrip_cache_sim_t"],
+    "drrip": ["rrip_cache_sim_t"],
+}
+ALL_POLICY_CLASSES = {c for classes in POLICY_CLASSES.values() for c in classes}
+
+_file_hashes = {}
+_source_hashes = {}
+_spike_version = None
+
+
+def file_hash(path):
+    stat = os.stat(path)
+    memo = (path, stat.st_mtime, stat.st_size)
+    if memo not in _file_hashes:
+        h = hashlib.sha256()
+        with open(path, "rb") as f:
+            for block in iter(lambda: f.read(1 << 20), b""):
+                h.update(block)
+        _file_hashes[memo] = h.hexdigest()
+    return _file_hashes[memo]
+
+
+def split_definitions(text):
+    # top-level declarations/definitions, a comment right before one belongs to it
+    chunks, current, depth, opened = [], [], 0, False
+    for line in text.split("\n"):
+        current.append(line)
+        code = re.sub(r'"(\\.|[^"\\])*"|\'(\\.|[^\'\\])*\'|//.*', "", line)
+        depth += code.count("{") - code.count("}")
+        opened = opened or "{" in code
+        if depth == 0 and (opened or code.rstrip().endswith(";")):
+            chunks.append("\n".join(current))
+            current, opened = [], False
+    chunks.append("\n".join(current))
+    return chunks
+
+
+def owner(chunk):
+    # the class of a class declaration or of a member function definition starting at column 0
+    match = re.search(r"^class (\w+)|^(?![\s/#])[^(]*?\b(\w+)::~?\w+\(", chunk, re.M)
+    return match and (match.group(1) or match.group(2))
+
+
+def source_hash(policy):
+    classes = POLICY_CLASSES.get(policy.split(":")[0], [])
+    memo = (tuple(classes),) + tuple(file_hash(source) for source in SOURCES)
+    if memo in _source_hashes:
+        return _source_hashes[memo]
+    h = hashlib.sha256()
+    for source in SOURCES:
+        with open(source) as f:
+            for chunk in split_definitions(f.read()):
+                name = owner(chunk)
+                if name not in ALL_POLICY_CLASSES or name in classes:
+                    h.update(chunk.encode())
+    _source_hashes[memo] = h.hexdigest()
+    return _source_hashes[memo]
+
+
+def spike_version():
+    global _spike_version
+    if _spike_version is None:
+        output = subprocess.run(["spike", "--help"], capture_output=True, text=True)
+        lines = (output.stdout + output.stderr).split("\n")
+        _spike_version = next((l.strip() for l in lines if "Spike" in l), lines[0].strip())
+    return _spike_version
+
+
+def key(program, cache_config, simulator):
+    policy = cache_config.split(":")[3] if cache_config.count(":") >= 3 else ""
+    parts = [file_hash(program), cache_config, source_hash(policy), simulator, FORMAT]
+    return hashlib.sha256(json.dumps(parts).encode()).hexdigest()
+
+
+def load(k):
+    try:
+        with open(os.path.join(CACHE_DIR, k[:2], k + ".json")) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return None
+
+
+def store(k, stats):
+    path = os.path.join(CACHE_DIR, k[:2], k + ".json")
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path + ".tmp", "w") as f:
+        json.dump(stats, f)
+    os.replace(path + ".tmp", path)
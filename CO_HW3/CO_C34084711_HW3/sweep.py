@@ -0,0 +1,158 @@
+import argparse
+import concurrent.futures
+import configparser
+import csv
+import itertools
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+import simcache
+
+# Runs every (benchmark x Set x Way x BlockSize x Policy) of the [sweep] section in config.conf on a
+# pool of workers and writes one row per run to sweep_results.csv. Each benchmark is compiled once
+# into sweep_build/. With --replay each benchmark is emulated once to record a trace, and every
+# configuration replays the trace with cachesim_replay instead of running Spike again.
+# The optional Victim key adds victim caches of that many entries to the grid (0 for none), e.g. to
+# compare a 1:2 cache with a 4-entry victim cache against a 1:4 one.
+# --sample=N simulates only about one in N sets of every cache with more than one set, the
+# miss_rate_ci95 column is then the half-width of the 95% confidence interval of the miss rate.
+# Every run writes its D$ counters with stats=, the results do not depend on the printed stats.
+# Results are kept in the content-addressed cache of simcache.py, so a run is only simulated again
+# when its program, configuration, policy source or simulator changed.
+
+BUILD_DIR = "sweep_build"
+
+
+def grid(config):
+    sweep = config['sweep']
+    values = [sweep.get(key, default).replace('"', '').split()
+              for key, default in (('Set', ''), ('Way', ''), ('BlockSize', ''), ('Policy', ''), ('Victim', '0'))]
+    return list(itertools.product(*values))
+
+
+def compile_benchmark(source):
+    binary = os.path.join(BUILD_DIR, os.path.splitext(os.path.basename(source))[0] + ".out")
+    if not os.path.exists(binary) or os.path.getmtime(binary) < os.path.getmtime(source):
+        subprocess.run(["riscv64-unknown-elf-gcc", "-march=rv64gc", "-static", "-o", binary, source], check=True)
+    return binary
+
+
+def record_trace(binary, pk):
+    trace = os.path.splitext(binary)[0] + ".trace"
+    if not os.path.exists(trace) or os.path.getmtime(trace) < os.path.getmtime(binary):
+        option = "1:1:64:trace=" + trace
+        subprocess.run(["spike", "--ic=" + option, "--dc=" + option, "--isa=RV64GC", pk, binary],
+                       check=True, stdout=subprocess.DEVNULL)
+    return trace
+
+
+def load_records(path):
+    # all records of a stats=path file (JSON), one per cache, None if the file is missing or broken
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return None
+
+
+def load_stats(path, name="D$"):
+    # the record of cache 'name' in a stats=path file, None if the file or the record is missing
+    return next((r for r in load_records(path) or [] if r["cache"] == name), None)
+
+
+def run_job(job, pk, replay, use_cache, sample):
+    benchmark, program, (cache_set, cache_way, cache_block_size, policy, victim) = job
+    cache_config = ":".join([cache_set, cache_way, cache_block_size, policy])
+    if victim != "0":
+        cache_config += ":victim=" + victim
+    if sample and int(cache_set) > 1:
+        cache_config += ":sample=%d" % sample
+    key = simcache.key(program, cache_config, "replay" if replay else simcache.spike_version())
+    stats = simcache.load(key) if use_cache else None
+    if stats is not None:
+        return job, stats, None, True
+    fd, stats_path = tempfile.mkstemp(suffix=".json", dir=BUILD_DIR)
+    os.close(fd)
+    option = cache_config + ":stats=" + stats_path + ":bench=" + os.path.splitext(benchmark)[0]
+    if replay:
+        command = ["./cachesim_replay", "--dc=" + option, program]
+    else:
+        command = ["spike", "--dc=" + option, "--isa=RV64GC", pk, program]
+    output = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    stats = load_stats(stats_path)
+    os.remove(stats_path)
+    if output.returncode != 0 or stats is None:
+        return job, None, output.stderr.strip().split("\n")[0], False
+    simcache.store(key, stats)
+    return job, stats, None, False
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="parallel cache configuration sweep")
+    parser.add_argument("--pk", default="/home/ubuntu/riscv/riscv64-unknown-elf/bin/pk")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--replay", action="store_true", help="record each benchmark once and replay the trace")
+    parser.add_argument("--output", default="sweep_results.csv")
+    parser.add_argument("--no-cache", action="store_true", help="simulate every run even if its result is cached")
+    parser.add_argument("--sample", type=int, default=0, metavar="N",
+                        help="estimate the miss rate from about one in N sets (sample=N), for a quick exploratory sweep")
+    args = parser.parse_args()
+
+    config = configparser.ConfigParser()
+    config.read('config.conf')
+    configs = grid(config)
+
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    sources = sorted(os.path.join("benchmark", f) for f in os.listdir("benchmark") if f.endswith(".c"))
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        binaries = list(pool.map(compile_benchmark, sources))
+        programs = binaries
+        if args.replay:
+            subprocess.run(["make", "cachesim_replay"], check=True, stdout=subprocess.DEVNULL)
+            programs = list(pool.map(lambda b: record_trace(b, args.pk), binaries))
+
+        jobs = [(os.path.basename(s), p, c) for (s, p) in zip(sources, programs) for c in configs]
+        print("%d benchmarks x %d configurations = %d runs on %d workers" % (len(sources), len(configs), len(jobs), args.jobs))
+        if not args.replay:
+            simcache.spike_version()
+        results = []
+        cached = 0
+        for done, (job, stats, error, hit) in enumerate(pool.map(lambda j: run_job(j, args.pk, args.replay, not args.no_cache, args.sample), jobs), 1):
+            if error is not None:
+                print("%s %s: %s" % (job[0], ":".join(job[2]), error), file=sys.stderr)
+            results.append((job, stats))
+            cached += hit
+            print("\r%d/%d (%d cached)" % (done, len(jobs), cached), end="", flush=True)
+        print()
+
+    # the counters of the stats records, their metadata is already in the first columns
+    metadata = ("cache", "config", "policy", "bench")
+    fields = list(dict.fromkeys(key for _, stats in results if stats for key in stats if key not in metadata))
+    with open(args.output, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["Benchmark", "Set", "Way", "BlockSize", "Policy", "Victim"] + fields)
+        for (benchmark, _, cache_config), stats in results:
+            writer.writerow([benchmark] + list(cache_config) + [stats.get(key, "") if stats else "" for key in fields])
+
+    # average miss rate over the benchmarks, one row per Set:Way:BlockSize(+victim entries), one column
+    # per policy; with a victim cache the misses it catches do not count
+    policies = list(dict.fromkeys(c[3] for c in configs))
+    average = {}
+    for (benchmark, _, cache_config), stats in results:
+        if stats:
+            caught = 100.0 * stats.get("victim_cache_hits", 0) / max(1, stats["read_accesses"] + stats["write_accesses"])
+            average.setdefault(cache_config, []).append(stats["miss_rate"] - caught)
+
+    print("\n=======================================================================")
+    print("Average D$ Miss Rate (%) over " + ", ".join(os.path.basename(s) for s in sources))
+    print("%-16s" % "Set:Way:Block" + "".join("%10s" % p for p in policies))
+    for geometry in dict.fromkeys(c[:3] + c[4:] for c in configs):
+        row = "%-16s" % (":".join(geometry[:3]) + ("+v" + geometry[3] if geometry[3] != "0" else ""))
+        for policy in policies:
+            rates = average.get(geometry[:3] + (policy,) + geometry[3:])
+            row += "%10.4f" % (sum(rates) / len(rates)) if rates and len(rates) == len(sources) else "%10s" % "-"
+        print(row)
+    print("Results: " + args.output)
@@ -3,16 +3,19 @@ import subprocess
 import os
 import sys
 
+import simcache
+from sweep import load_stats
+
 if __name__ == "__main__":
     config = configparser.ConfigParser()
     config.read('config.conf')
     cache_set =  config['cache']['Set']
     cache_way =  config['cache']['Way']
     cache_block_size = config['cache']['BlockSize']
-    policy = config['cache']['Policy']
+    policy = config['cache']['Policy'].strip('"')
     
     if (sys.argv[1] == "build"):
-        os.system("make " + policy)
+        os.system("make install")
     elif (sys.argv[1] != "test"):
         print("wrong argument")
         exit(0)
@@ -25,16 +28,26 @@ if __name__ == "__main__":
 
     for benchmark in benchmarks:
         os.system("make compile FILE_NAME=./benchmark/" + benchmark)
-        output = subprocess.run(["make", "run", "CACHE_SET=" + cache_set, "CACHE_WAY=" + cache_way, "CACHE_BLOCKSIZE=" + cache_block_size], capture_output=True, text=True)
-        lines = output.stdout.split("\n")
-        avg_miss_rate += float(lines[-2].split()[3].split('%')[0])
+        # 相同的 a.out、cache 設定、policy 原始碼與 spike 版本直接使用之前的結果
+        key = simcache.key("a.out", ":".join([cache_set, cache_way, cache_block_size, policy]), simcache.spike_version())
+        stats = simcache.load(key)
+        if stats is None:
+            options = "stats=stats.json:bench=" + os.path.splitext(benchmark)[0]
+            subprocess.run(["make", "run", "CACHE_SET=" + cache_set, "CACHE_WAY=" + cache_way, "CACHE_BLOCKSIZE=" + cache_block_size, "CACHE_POLICY=" + policy, "CACHE_OPTIONS=" + options], stdout=subprocess.DEVNULL)
+            stats = load_stats("stats.json")
+            if stats is None:
+                # the single-policy builds (make origin/fifo/lru/lfu/self) do not know stats=
+                os.system("make clean")
+                sys.exit("no stats from spike for " + benchmark + ", rebuild it with make install")
+            os.remove("stats.json")
+            simcache.store(key, stats)
+        avg_miss_rate += stats["miss_rate"]
 
     avg_miss_rate /= len(benchmarks)
     os.system("make clean")
 
     print("\n\n=======================================================================")
-    if (sys.argv[1] == "build"):
-        print("Policy: " + policy)
+    print("Policy: " + policy)
     print("Data Cache Setting with: " + str(cache_set) + ":" + str(cache_way) + ':' + str(cache_block_size))
     print("Miss Rate: " + str(round(avg_miss_rate, 4)) + " %")
         